@@ -0,0 +1,88 @@
+#include "../include/cutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Double formatting against snprintf.
+//
+// Build and run from the repository root:
+//   cc -O2 bench/float.c src/cutil.c -o bench_float -lm -lpthread && ./bench_float
+
+#define NUMBER_OF_VALUES (1 << 20)
+
+static double Now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void Report(const char *name, double seconds, size_t bytes) {
+  printf("%-34s %7.1f ns/value  (%zu bytes)\n", name, seconds * 1e9 / NUMBER_OF_VALUES, bytes);
+}
+
+int main(void) {
+  double *values = malloc(NUMBER_OF_VALUES * sizeof(double));
+  if (values == NULL) {
+    return 1;
+  }
+  // Metric-like values: a few significant digits over a range of magnitudes.
+  srand(17);
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    double magnitude = 1;
+    for (int k = rand() % 12; k > 0; k--) {
+      magnitude *= 10;
+    }
+    values[i] = (double)rand() / RAND_MAX * magnitude;
+  }
+
+  char buffer[64];
+  size_t bytes = 0;
+  double t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    DoubleToStringToBuffer(buffer, sizeof(buffer), values[i]);
+    bytes += strlen(buffer);
+  }
+  Report("DoubleToStringToBuffer", Now() - t, bytes);
+
+  bytes = 0;
+  t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    bytes += snprintf(buffer, sizeof(buffer), "%.17g", values[i]);
+  }
+  Report("snprintf %.17g", Now() - t, bytes);
+
+  bytes = 0;
+  t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    DoubleToFixedStringToBuffer(buffer, sizeof(buffer), values[i], 6);
+    bytes += strlen(buffer);
+  }
+  Report("DoubleToFixedStringToBuffer 6", Now() - t, bytes);
+
+  bytes = 0;
+  t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    bytes += snprintf(buffer, sizeof(buffer), "%.6f", values[i]);
+  }
+  Report("snprintf %.6f", Now() - t, bytes);
+
+  bytes = 0;
+  t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    Sprintf(buffer, sizeof(buffer), "v=%f;", values[i]);
+    bytes += strlen(buffer);
+  }
+  Report("Sprintf v=%f;", Now() - t, bytes);
+
+  bytes = 0;
+  t = Now();
+  for (size_t i = 0; i < NUMBER_OF_VALUES; i++) {
+    bytes += snprintf(buffer, sizeof(buffer), "v=%.17g;", values[i]);
+  }
+  Report("snprintf v=%.17g;", Now() - t, bytes);
+
+  free(values);
+  return 0;
+}
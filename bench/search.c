@@ -0,0 +1,95 @@
+#include "../include/cutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Substring search on a 1 MB haystack.
+//
+// Build and run from the repository root:
+//   cc -O2 bench/search.c src/cutil.c -o bench_search -lm -lpthread && ./bench_search
+//
+// "naive" is the StringFirstIndexOf that StringSearcher replaced, which
+// called StringStartsWith (and so strlen) at every offset.
+
+#define HAYSTACK_SIZE (1 << 20)
+
+static double Now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int64_t NaiveFirstIndexOf(const char *s, const char *search) {
+  for (int64_t i = 0; s[i] != '\0'; i++) {
+    size_t length = strlen(s + i), search_length = strlen(search);
+    if (length >= search_length && memcmp(s + i, search, search_length) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void Run(const char *name, const char *haystack, const char *needle, int rounds) {
+  volatile int64_t sink = 0;
+  StringSearcher ss = CreateStringSearcher(needle);
+  size_t length = strlen(haystack);
+
+  double t = Now();
+  for (int i = 0; i < rounds; i++) {
+    sink += StringFirstIndexOf(haystack, needle);
+  }
+  double first_index_of = (Now() - t) / rounds;
+
+  t = Now();
+  for (int i = 0; i < rounds; i++) {
+    sink += StringSearcherFind(&ss, haystack, length);
+  }
+  double searcher = (Now() - t) / rounds;
+
+  t = Now();
+  for (int i = 0; i < rounds; i++) {
+    sink += strstr(haystack, needle) != NULL;
+  }
+  double libc = (Now() - t) / rounds;
+
+  // The naive search is quadratic, so it only gets the last 64 KB.
+  t = Now();
+  sink += NaiveFirstIndexOf(haystack + length - 65536, needle);
+  double naive = Now() - t;
+
+  printf("%-26s %9.3f %9.3f %9.3f %12.1f\n", name, first_index_of * 1e3, searcher * 1e3, libc * 1e3, naive * 1e3);
+}
+
+int main(void) {
+  char *text = malloc(HAYSTACK_SIZE + 1);
+  char *same = malloc(HAYSTACK_SIZE + 1);
+  char *adversarial = malloc(1002);
+  if (text == NULL || same == NULL || adversarial == NULL) {
+    return 1;
+  }
+
+  srand(2);
+  for (size_t i = 0; i < HAYSTACK_SIZE; i++) {
+    text[i] = " etaoinshrdlu"[rand() % 13];
+  }
+  text[HAYSTACK_SIZE] = '\0';
+  memset(same, 'a', HAYSTACK_SIZE);
+  same[HAYSTACK_SIZE] = '\0';
+  memset(adversarial, 'a', 1000);
+  adversarial[1000] = 'b';
+  adversarial[1001] = '\0';
+
+  printf("%-26s %9s %9s %9s %12s  (ms per search)\n", "needle", "IndexOf", "Searcher", "strstr", "naive 64KB");
+  Run("2 bytes, absent", text, "zq", 50);
+  Run("6 bytes, absent", text, "needle", 50);
+  Run("25 bytes, absent", text, "the quick brown fox jumps", 50);
+  Run("64 bytes, periodic", text, "tttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttz", 50);
+  Run("a^1000 b in a^n", same, adversarial, 5);
+
+  free(text);
+  free(same);
+  free(adversarial);
+  return 0;
+}
@@ -18,10 +18,33 @@
 #pragma endregion
 #pragma region Char and String
 
+/**
+ * ASCII character classes as looked up from a 256 entry table. Bytes >= 128
+ * belong to no class.
+*/
+typedef enum CharClass {
+  CHAR_CLASS_UPPER = 1,
+  CHAR_CLASS_LOWER = 2,
+  CHAR_CLASS_DIGIT = 4,
+  CHAR_CLASS_SPACE = 8,
+  CHAR_CLASS_PUNCT = 16,
+  CHAR_CLASS_HEX = 32,
+  CHAR_CLASS_ALPHA = CHAR_CLASS_UPPER | CHAR_CLASS_LOWER,
+  CHAR_CLASS_ALNUM = CHAR_CLASS_ALPHA | CHAR_CLASS_DIGIT,
+} CharClass;
+
+/**
+ * Whether c belongs to any of the classes.
+*/
+bool CharIsClass(char c, CharClass classes);
 bool CharIsAlpha(char c);
 bool CharIsDigit(char c);
+bool CharIsAlphaNumeric(char c);
 bool CharIsUpper(char c);
 bool CharIsLower(char c);
+bool CharIsSpace(char c);
+bool CharIsPunct(char c);
+bool CharIsHexDigit(char c);
 bool CharIn(char c, const char *haystack);
 
 char CharUpper(char c);
@@ -29,18 +52,25 @@ char CharLower(char c);
 
 size_t StringLength(const char *s);
 
+/**
+ * Whether every character of s belongs to one of the classes.
+*/
+bool StringIsClass(const char *s, CharClass classes);
 bool StringIsAlpha(const char *s);
 bool StringIsNumeric(const char *s);
 bool StringIsAlphaNumeric(const char *s);
 
 bool  StringUpperToBuffer(char *buffer, size_t buffer_size, const char *s);
 char* StringUpperAlloc(const char *s);
+void  StringUpperInPlace(char *s);
 
 bool  StringLowerToBuffer(char *buffer, size_t buffer_size, const char *s);
 char* StringLowerAlloc(const char *s);
+void  StringLowerInPlace(char *s);
 
 bool  StringTitleToBuffer(char *buffer, size_t buffer_size, const char *s);
 char* StringTitleAlloc(const char *s);
+void  StringTitleInPlace(char *s);
 
 bool  StringConcatToBuffer(char *buffer, size_t buffer_size, const char *s1, const char *s2);
 char* StringConcatAlloc(const char *s1, const char *s2);
@@ -60,6 +90,14 @@ char* StringReverseAlloc(const char *s);
 bool  StringReplaceToBuffer(char *buffer, size_t buffer_size, const char *s, const char *search, const char *replace);
 char* StringReplaceAlloc(const char *s, const char *search, const char *replace);
 
+/**
+ * Replace every searches[i] with replaces[i] in a single pass over s.
+ * Matches are taken leftmost first, and the longest search wins among those
+ * that start at the same position. Identical searches use the first pair.
+*/
+bool  StringReplaceManyToBuffer(char *buffer, size_t buffer_size, const char *s, const char **searches, const char **replaces, uint64_t number_of_pairs);
+char* StringReplaceManyAlloc(const char *s, const char **searches, const char **replaces, uint64_t number_of_pairs);
+
 bool  StringRepeatToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n);
 char* StringRepeatAlloc(const char *s, int n);
 
@@ -71,6 +109,19 @@ bool StringEquals(const char *s1, const char *s2);
 bool StringStartsWith(const char *s1, const char *s2);
 bool StringEndsWith(const char *s1, const char *s2);
 
+/**
+ * Three way byte comparison, returns -1, 0 or 1.
+*/
+int StringCompare(const char *s1, const char *s2);
+
+/**
+ * Comparisons that treat ASCII letters of either case as equal.
+*/
+bool StringEqualsIgnoreCase(const char *s1, const char *s2);
+bool StringStartsWithIgnoreCase(const char *s1, const char *s2);
+bool StringEndsWithIgnoreCase(const char *s1, const char *s2);
+int  StringCompareIgnoreCase(const char *s1, const char *s2);
+
 int64_t StringFirstIndexOf(const char *s, const char *search);
 int64_t StringLastIndexOf(const char *s, const char *search);
 
@@ -79,9 +130,188 @@ char* StringDuplicate(const char *s);
 bool  StringsJoinToBuffer(char *buffer, size_t buffer_size, char **strings, uint64_t number_of_strings, char *separator);
 char* StringsJoinAlloc(char **strings, uint64_t number_of_strings, char *separator);
 
+/**
+ * Write at most buffer_size - 1 characters and a NUL terminator, output that
+ * does not fit is cut off.
+*/
 void Sprintf(char *buffer, size_t buffer_size, const char *format, ...);
 void Sappendf(char *buffer, size_t buffer_size, const char *format, ...);
 
+#pragma endregion
+#pragma region String View
+
+/**
+ * Non-owning slice of a string, not necessarily NUL terminated. Views never
+ * allocate, the viewed memory must outlive the view.
+*/
+typedef struct StringView {
+  const char *ptr;
+  size_t len;
+} StringView;
+
+#define StringViewLiteral(s) ((StringView){(s), sizeof(s) - 1})
+
+StringView CreateStringView(const char *s);
+
+/**
+ * Bytes [start, end) of sv, clamped to its length.
+*/
+StringView StringViewSlice(StringView sv, size_t start, size_t end);
+StringView StringViewFirstN(StringView sv, size_t n);
+StringView StringViewLastN(StringView sv, size_t n);
+
+/**
+ * Number of leading characters of sv that belong to one of the classes.
+*/
+size_t StringViewSpanClass(StringView sv, CharClass classes);
+
+StringView StringViewTrim(StringView sv);
+StringView StringViewTrimLeft(StringView sv);
+StringView StringViewTrimRight(StringView sv);
+
+/**
+ * Split sv around the first separator. Returns false when there is none,
+ * then before is sv and after is empty.
+*/
+bool StringViewCut(StringView sv, char separator, StringView *before, StringView *after);
+
+int64_t StringViewFindChar(StringView sv, char c);
+int64_t StringViewFindLastChar(StringView sv, char c);
+int64_t StringViewFind(StringView sv, StringView search);
+int64_t StringViewFindLast(StringView sv, StringView search);
+
+bool StringViewEquals(StringView a, StringView b);
+int  StringViewCompare(StringView a, StringView b);
+bool StringViewStartsWith(StringView sv, StringView prefix);
+bool StringViewEndsWith(StringView sv, StringView suffix);
+
+bool StringViewEqualsIgnoreCase(StringView a, StringView b);
+int  StringViewCompareIgnoreCase(StringView a, StringView b);
+bool StringViewStartsWithIgnoreCase(StringView sv, StringView prefix);
+bool StringViewEndsWithIgnoreCase(StringView sv, StringView suffix);
+
+uint64_t StringViewHash(StringView sv);
+
+bool  StringViewToBuffer(char *buffer, size_t buffer_size, StringView sv);
+char* StringViewAlloc(StringView sv);
+
+/**
+ * Length of the views joined with separator, without the NUL terminator.
+*/
+size_t StringViewsJoinLength(const StringView *views, uint64_t number_of_views, StringView separator);
+bool   StringViewsJoinToBuffer(char *buffer, size_t buffer_size, const StringView *views, uint64_t number_of_views, StringView separator);
+char*  StringViewsJoinAlloc(const StringView *views, uint64_t number_of_views, StringView separator);
+
+#pragma endregion
+#pragma region String Search
+
+/**
+ * Precompiled needle for finding it in many haystacks.
+ * The needle is not copied and must outlive the searcher.
+ * A reverse searcher finds the last occurrence instead of the first.
+*/
+typedef struct StringSearcher {
+  const char *needle;
+  size_t length;
+  size_t period;
+  int64_t critical;
+  bool periodic;
+  bool reverse;
+  uint8_t shift[256];
+} StringSearcher;
+
+StringSearcher CreateStringSearcher(const char *needle);
+StringSearcher CreateReverseStringSearcher(const char *needle);
+
+int64_t StringSearcherFind(const StringSearcher *ss, const char *s, size_t length);
+
+typedef struct CharSet {
+  uint64_t bits[4];
+} CharSet;
+
+CharSet CreateCharSet(const char *chars);
+bool CharSetContains(const CharSet *set, char c);
+bool StringContainsCharSet(const char *s, const CharSet *set);
+
+/**
+ * Aho-Corasick automaton matching any number of patterns in one pass.
+ * Identical patterns are reported once, with the lowest index.
+*/
+typedef struct StringMatcher {
+  uint8_t classes[256];
+  size_t number_of_classes;
+  size_t number_of_states;
+  uint64_t number_of_patterns;
+  uint32_t *transitions;
+  uint32_t *matches;
+  uint32_t *links;
+  size_t *lengths;
+} StringMatcher;
+
+/**
+ * Called for every match, start and end are byte offsets from the beginning
+ * of the input (or stream). Return false to stop matching.
+*/
+typedef bool (*StringMatcherCallback)(void *context, uint64_t pattern_index, uint64_t start, uint64_t end);
+
+bool AllocateStringMatcher(StringMatcher *sm, const char **patterns, uint64_t number_of_patterns);
+bool DeallocateStringMatcher(StringMatcher *sm);
+
+bool StringMatcherContains(const StringMatcher *sm, const char *s, size_t length);
+bool StringMatcherFind(const StringMatcher *sm, const char *s, size_t length, StringMatcherCallback callback, void *context);
+
+typedef struct StringMatcherStream {
+  const StringMatcher *matcher;
+  uint32_t row;
+  uint64_t offset;
+} StringMatcherStream;
+
+StringMatcherStream CreateStringMatcherStream(const StringMatcher *sm);
+bool StringMatcherStreamFeed(StringMatcherStream *stream, const char *chunk, size_t length, StringMatcherCallback callback, void *context);
+
+#pragma endregion
+#pragma region String Split
+
+typedef enum StringSplitMode {
+  STRING_SPLIT_CHAR,
+  STRING_SPLIT_STRING,
+  STRING_SPLIT_ANY,
+} StringSplitMode;
+
+/**
+ * Lazy split of a view into the views between separators. Tokens point into
+ * the source and nothing is allocated. n separators give n + 1 tokens, so
+ * empty fields are kept. The separator string must outlive the iterator.
+*/
+typedef struct StringSplitIterator {
+  StringView rest;
+  bool done;
+  StringSplitMode mode;
+  bool ascii;
+  uint8_t nibbles[16];
+  union {
+    char separator;
+    CharSet set;
+    StringSearcher searcher;
+  };
+} StringSplitIterator;
+
+StringSplitIterator CreateStringSplitIteratorChar(StringView s, char separator);
+StringSplitIterator CreateStringSplitIterator(StringView s, const char *separator);
+
+/**
+ * Split at any one of the bytes in chars.
+*/
+StringSplitIterator CreateStringSplitIteratorAny(StringView s, const char *chars);
+
+bool StringSplitNext(StringSplitIterator *it, StringView *token);
+
+/**
+ * Store up to max_tokens of the next tokens and return how many were stored.
+ * The iterator can be resumed after a full array.
+*/
+size_t StringSplitToArray(StringSplitIterator *it, StringView *tokens, size_t max_tokens);
+
 #pragma endregion
 #pragma region String Builder
 
@@ -90,6 +320,7 @@ typedef struct StringBuilder {
   char *string;
   size_t capacity;
   size_t length;
+  struct Arena *arena;
 } StringBuilder;
 
 StringBuilder CreateStaticStringBuilder(char *buffer, size_t buffer_size);
@@ -98,13 +329,150 @@ bool AllocateStringBuilder(StringBuilder *sb, size_t initial_capacity);
 bool DeallocateStringBuilder(StringBuilder *sb);
 
 bool StringBuilderCapacityRealloc(StringBuilder *sb, size_t padding);
+bool StringBuilderReserve(StringBuilder *sb, size_t additional);
+bool StringBuilderShrinkToFit(StringBuilder *sb);
 bool StringBuilderAddChar(StringBuilder *sb, char c);
+bool StringBuilderAddBytes(StringBuilder *sb, const char *bytes, size_t length);
 bool StringBuilderAddString(StringBuilder *sb, const char *s);
+bool StringBuilderAddView(StringBuilder *sb, StringView sv);
+StringView StringBuilderView(const StringBuilder *sb);
 bool StringBuilderReadFile(StringBuilder *sb, const char *file_path);
 bool StringBuilderClear(StringBuilder *sb);
 
 bool StringBuilderPrintf(StringBuilder *sb, const char *format, ...);
 
+#pragma endregion
+#pragma region Format
+
+typedef struct FormatSegment {
+  const char *literal;
+  size_t length;
+  char conversion;
+  int precision;
+} FormatSegment;
+
+/**
+ * Format string parsed once into literal runs and conversions. The segments
+ * point into the format string, which must outlive the compiled format.
+*/
+typedef struct CompiledFormat {
+  FormatSegment *segments;
+  size_t number_of_segments;
+} CompiledFormat;
+
+bool AllocateCompiledFormat(CompiledFormat *cf, const char *format);
+bool DeallocateCompiledFormat(CompiledFormat *cf);
+
+void SprintfCompiled(char *buffer, size_t buffer_size, const CompiledFormat *cf, ...);
+void SappendfCompiled(char *buffer, size_t buffer_size, const CompiledFormat *cf, ...);
+bool StringBuilderPrintfCompiled(StringBuilder *sb, const CompiledFormat *cf, ...);
+void PrintfCompiled(const CompiledFormat *cf, ...);
+void ErrorfCompiled(const CompiledFormat *cf, ...);
+
+bool WriteFormatToFd(int fd, const char *format, ...);
+bool WriteCompiledFormatToFd(int fd, const CompiledFormat *cf, ...);
+
+typedef enum FormatArgType {
+  FORMAT_ARG_INT64,
+  FORMAT_ARG_UINT64,
+  FORMAT_ARG_CHAR,
+  FORMAT_ARG_BOOL,
+  FORMAT_ARG_STRING,
+  FORMAT_ARG_DOUBLE,
+  FORMAT_ARG_FLOAT,
+} FormatArgType;
+
+typedef struct FormatArg {
+  FormatArgType type;
+  union {
+    int64_t i;
+    uint64_t u;
+    const char *s;
+    double d;
+  };
+} FormatArg;
+
+FormatArg FormatArgInt64(int64_t value);
+FormatArg FormatArgUint64(uint64_t value);
+FormatArg FormatArgChar(char value);
+FormatArg FormatArgBool(bool value);
+FormatArg FormatArgString(const char *value);
+FormatArg FormatArgDouble(double value);
+FormatArg FormatArgFloat(float value);
+
+/**
+ * Format argument of the static type of x. Arguments of any other type
+ * (long double, pointers, structs) do not compile.
+*/
+#define ToFormatArg(x) _Generic((x),\
+  bool: FormatArgBool,\
+  char: FormatArgChar,\
+  signed char: FormatArgInt64,\
+  short: FormatArgInt64,\
+  int: FormatArgInt64,\
+  long: FormatArgInt64,\
+  long long: FormatArgInt64,\
+  unsigned char: FormatArgUint64,\
+  unsigned short: FormatArgUint64,\
+  unsigned int: FormatArgUint64,\
+  unsigned long: FormatArgUint64,\
+  unsigned long long: FormatArgUint64,\
+  float: FormatArgFloat,\
+  double: FormatArgDouble,\
+  char*: FormatArgString,\
+  const char*: FormatArgString)(x)
+
+#define FORMAT_ARGS_COUNT(...)\
+  FORMAT_ARGS_COUNT_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define FORMAT_ARGS_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+
+#define FORMAT_ARGS_CONCAT(a, b) FORMAT_ARGS_CONCAT_(a, b)
+#define FORMAT_ARGS_CONCAT_(a, b) a##b
+
+#define FORMAT_ARGS_MAP_1(x) ToFormatArg(x)
+#define FORMAT_ARGS_MAP_2(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_1(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_3(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_2(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_4(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_3(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_5(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_4(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_6(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_5(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_7(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_6(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_8(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_7(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_9(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_8(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_10(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_9(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_11(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_10(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_12(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_11(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_13(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_12(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_14(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_13(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_15(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_14(__VA_ARGS__)
+#define FORMAT_ARGS_MAP_16(x, ...) ToFormatArg(x), FORMAT_ARGS_MAP_15(__VA_ARGS__)
+
+/**
+ * Typed argument array and its length, for up to 16 arguments.
+*/
+#define FORMAT_ARGS(...)\
+  (const FormatArg[]){FORMAT_ARGS_CONCAT(FORMAT_ARGS_MAP_, FORMAT_ARGS_COUNT(__VA_ARGS__))(__VA_ARGS__)},\
+  FORMAT_ARGS_COUNT(__VA_ARGS__)
+
+/**
+ * Typed versions of the printf-like functions. Each argument is printed by
+ * its own type: %d, %i and %u take any integer, %c a char or integer, %s a
+ * string, %b/%B a bool or integer and %f a float or double. A conversion
+ * that does not fit its argument, or a wrong number of arguments, returns
+ * false.
+*/
+bool SprintfArgs(char *buffer, size_t buffer_size, const char *format, const FormatArg *args, size_t number_of_args);
+bool SappendfArgs(char *buffer, size_t buffer_size, const char *format, const FormatArg *args, size_t number_of_args);
+bool StringBuilderPrintfArgs(StringBuilder *sb, const char *format, const FormatArg *args, size_t number_of_args);
+
+#define SprintfTyped(buffer, buffer_size, format, ...)\
+  SprintfArgs(buffer, buffer_size, format, FORMAT_ARGS(__VA_ARGS__))
+
+#define SappendfTyped(buffer, buffer_size, format, ...)\
+  SappendfArgs(buffer, buffer_size, format, FORMAT_ARGS(__VA_ARGS__))
+
+#define StringBuilderPrintfTyped(sb, format, ...)\
+  StringBuilderPrintfArgs(sb, format, FORMAT_ARGS(__VA_ARGS__))
+
 #pragma endregion
 #pragma region File System
 
@@ -124,6 +492,10 @@ char* PathExt(const char *file_path);
 bool  PathExtToBuffer(char *buffer, size_t buffer_size, const char *file_path);
 char* PathExtAlloc(const char *file_path);
 
+StringView PathBaseNameView(const char *file_path);
+StringView PathDirNameView(const char *file_path);
+StringView PathExtView(const char *file_path);
+
 #pragma endregion
 #pragma region IO
 
@@ -134,11 +506,55 @@ char* PathExtAlloc(const char *file_path);
   Errorf(fmt "\n", ##__VA_ARGS__)
 
 #define DebugLog(fmt, ...)\
-  Errorf("[%s:%d %s] " fmt "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__)
+  Errorf("[%s:%d %s] " fmt "\n", __FILE__, (int64_t)__LINE__, __func__, ##__VA_ARGS__)
 
 bool  ReadFileToBuffer(char *buffer, size_t buffer_size, const char *file_path);
 char* ReadFileAlloc(const char *file_path);
 
+/**
+ * Read-only view of a whole file. Regular files are memory mapped, anything
+ * else is read into memory once. The data of a mapped file is not NUL
+ * terminated.
+*/
+typedef struct MappedFile {
+  const char *data;
+  size_t size;
+  bool is_mapped;
+} MappedFile;
+
+bool AllocateMappedFile(MappedFile *mf, const char *file_path);
+bool DeallocateMappedFile(MappedFile *mf);
+
+/**
+ * Reads a file or file descriptor in large blocks and yields its lines as
+ * views into the block, without the line break (\n or \r\n). A line view
+ * stays valid until the next call. Memory use is one block, or the longest
+ * line if that is larger. After the last line, failed tells whether reading
+ * stopped on an error instead of the end of the input.
+*/
+typedef struct LineReader {
+  int fd;
+  bool owns_fd;
+  bool eof;
+  bool failed;
+  char *buffer;
+  size_t capacity;
+  size_t start;
+  size_t scanned;
+  size_t end;
+  uint64_t line_number;
+} LineReader;
+
+bool AllocateLineReader(LineReader *lr, const char *file_path);
+
+/**
+ * Read from an open descriptor, such as 0 for stdin. The descriptor is not
+ * closed by DeallocateLineReader.
+*/
+bool AllocateLineReaderFd(LineReader *lr, int fd);
+bool DeallocateLineReader(LineReader *lr);
+bool LineReaderNext(LineReader *lr, StringView *line);
+
 bool  ReadUserInputToBuffer(char *buffer, size_t buffer_size);
 bool  ReadUserInputToStringBuilder(StringBuilder *sb);
 char* ReadUserInputAlloc(void);
@@ -164,6 +580,54 @@ bool AppendFormatToFile(const char *file_path, const char *format, ...);
 void WriteCharToStdOut(char c);
 void WriteCharToStdErr(char c);
 
+/**
+ * Collect stdout/stderr records of the calling thread in a buffer instead of
+ * writing each one right away. Pending output is written when the buffer
+ * fills up, on OutputFlush, or when buffering is turned off again. Turn it
+ * off before the thread exits, which also frees the buffer.
+*/
+void OutputSetBuffered(bool buffered);
+void OutputFlush(void);
+
+bool PrintfArgs(const char *format, const FormatArg *args, size_t number_of_args);
+bool ErrorfArgs(const char *format, const FormatArg *args, size_t number_of_args);
+
+#define PrintfTyped(format, ...)\
+  PrintfArgs(format, FORMAT_ARGS(__VA_ARGS__))
+
+#define ErrorfTyped(format, ...)\
+  ErrorfArgs(format, FORMAT_ARGS(__VA_ARGS__))
+
+#define ASYNC_LOG_RECORD_SIZE 256
+#define ASYNC_LOG_DEFAULT_CAPACITY 4096
+
+#define AsyncLogln(log, fmt, ...)\
+  AsyncLogf(log, fmt "\n", ##__VA_ARGS__)
+
+#define AsyncDebugLog(log, fmt, ...)\
+  AsyncLogf(log, "[%s:%d %s] " fmt "\n", __FILE__, (int64_t)__LINE__, __func__, ##__VA_ARGS__)
+
+typedef enum AsyncLogPolicy {
+  ASYNC_LOG_DROP,
+  ASYNC_LOG_BLOCK,
+} AsyncLogPolicy;
+
+/**
+ * Background logger. AsyncLogf formats the record on the calling thread into
+ * a ring of capacity records, a writer thread appends them to file_path
+ * (stderr when NULL) in batches. When the ring is full, the record is dropped
+ * or the caller sleeps until the writer has made room, depending on the
+ * policy. Records longer than ASYNC_LOG_RECORD_SIZE are truncated. Pending
+ * records are written on exit and by AsyncLogFlush.
+*/
+typedef struct AsyncLog AsyncLog;
+
+AsyncLog* NewAsyncLog(const char *file_path, size_t capacity, AsyncLogPolicy policy);
+void      FreeAsyncLog(AsyncLog *log);
+bool      AsyncLogf(AsyncLog *log, const char *format, ...);
+void      AsyncLogFlush(AsyncLog *log);
+uint64_t  AsyncLogDropped(AsyncLog *log);
+
 #pragma endregion
 #pragma region Util
 
@@ -178,6 +642,45 @@ bool CreateAllocation(Allocation *a, size_t size);
 bool ResizeAllocation(Allocation *a, size_t size);
 void FreeAllocation(Allocation *a);
 
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *previous;
+  Allocation allocation;
+  size_t used;
+} ArenaBlock;
+
+/**
+ * Bump allocator over a chain of blocks. Memory is released all at once,
+ * with ArenaReset, ArenaRewind or FreeArena.
+*/
+typedef struct Arena {
+  ArenaBlock *block;
+  size_t block_size;
+} Arena;
+
+typedef struct ArenaMark {
+  ArenaBlock *block;
+  size_t used;
+} ArenaMark;
+
+Arena CreateArena(size_t block_size);
+void* ArenaAlloc(Arena *arena, size_t size);
+void* ArenaRealloc(Arena *arena, void *memory, size_t old_size, size_t new_size);
+ArenaMark CreateArenaMark(Arena *arena);
+void ArenaRewind(Arena *arena, ArenaMark mark);
+void ArenaReset(Arena *arena);
+void FreeArena(Arena *arena);
+
+/**
+ * Make every *Alloc function (and new dynamic string builders) allocate from
+ * the arena on the calling thread, until UseArena is called again.
+ * Memory from an arena must not be passed to free.
+ * @param arena The arena to use, or NULL to go back to malloc.
+ * @return The arena that was in use before.
+*/
+Arena* UseArena(Arena *arena);
+
 typedef struct MemoryAllocation {
   void *memory;
   size_t size_of_item;
@@ -188,8 +691,56 @@ bool CreateMemoryAllocation(MemoryAllocation *ma, size_t size_of_item, uint64_t
 bool ResizeMemoryAllocation(MemoryAllocation *ma, uint64_t number_of_items);
 void FreeMemoryAllocation(MemoryAllocation *ma);
 
+#define MEMORY_POOL_DEFAULT_ITEMS_PER_SLAB 256
+
+/**
+ * Pool of fixed size items allocated in slabs. Freed items are kept on a
+ * free list for reuse, FreeMemoryPool releases every slab at once.
+*/
+typedef struct MemoryPool {
+  size_t size_of_item;
+  uint64_t items_per_slab;
+  void *free_list;
+  void *slabs;
+} MemoryPool;
+
+bool  CreateMemoryPool(MemoryPool *mp, size_t size_of_item, uint64_t items_per_slab);
+void* MemoryPoolAlloc(MemoryPool *mp);
+void  MemoryPoolFree(MemoryPool *mp, void *item);
+void  FreeMemoryPool(MemoryPool *mp);
+
 uint64_t Hash(const char *s);
 
+/**
+ * Fast non-cryptographic hash (wyhash), 48 bytes per step.
+*/
+uint64_t HashBytes(const void *data, size_t length, uint64_t seed);
+
+/**
+ * Keyed SipHash-1-3, for tables filled with untrusted keys.
+*/
+uint64_t SipHash(const void *data, size_t length, uint64_t k0, uint64_t k1);
+
+/**
+ * Streaming SipHash-1-3 over input that is not contiguous in memory.
+ * Feeding the same bytes in any split gives the same result as SipHash.
+*/
+typedef struct Hasher {
+  uint64_t v0, v1, v2, v3;
+  uint64_t tail;
+  uint64_t length;
+} Hasher;
+
+Hasher   CreateHasher(uint64_t k0, uint64_t k1);
+void     HasherUpdate(Hasher *h, const void *data, size_t length);
+uint64_t HasherFinish(const Hasher *h);
+
+/**
+ * Random 64 bit value from the operating system's entropy source, used to
+ * key the SipHash of every StringHashMap.
+*/
+uint64_t RandomSeed(void);
+
 typedef struct Url {
   char scheme[16];
   char host[64];
@@ -198,8 +749,124 @@ typedef struct Url {
   char *query;
 } Url;
 
+/**
+ * Parse s into the fixed size Url. Components that do not fit are truncated,
+ * use UrlParseView for exact results. Unlike UrlParseView, text without a
+ * "scheme://" prefix starts with the host, as in "example.com:8080/path".
+*/
 Url UrlParse(const char *s);
 
+/**
+ * Components of a URL as views into the parsed string. The path is always
+ * set, other missing components have a NULL ptr, so "?" gives an empty but
+ * present query. The host of an IPv6 literal is given without brackets.
+*/
+typedef struct UrlView {
+  StringView scheme;
+  StringView userinfo;
+  StringView host;
+  StringView port;
+  StringView path;
+  StringView query;
+  StringView fragment;
+} UrlView;
+
+/**
+ * Parse s in one pass without copying, following RFC 3986. A scheme is only
+ * taken from a leading "name:", and a host only after "//", so "mailto:a@b"
+ * has the path "a@b" and "foo/bar" is a path. An empty port, as in "h:/",
+ * is accepted and UrlViewPort then gives the default. Returns false for a
+ * port that is not a number of up to five digits no greater than 65535 or an
+ * unterminated IPv6 host.
+*/
+bool UrlParseView(StringView s, UrlView *url);
+
+/**
+ * Parse inputs until the first invalid one and return how many were parsed.
+*/
+size_t UrlParseBatch(const StringView *inputs, UrlView *urls, size_t number_of_urls);
+
+/**
+ * The explicit port, else the default port of http and https, else -1.
+*/
+int32_t UrlViewPort(const UrlView *url);
+
+/**
+ * Iterates key=value pairs of a query, skipping empty pairs. A pair without
+ * '=' has an empty value.
+*/
+typedef struct UrlQueryIterator {
+  StringSplitIterator pairs;
+  bool decode;
+} UrlQueryIterator;
+
+UrlQueryIterator CreateUrlQueryIterator(StringView query);
+
+/**
+ * Like CreateUrlQueryIterator, but every key and value is percent-decoded in
+ * place before it is returned.
+*/
+UrlQueryIterator CreateUrlQueryIteratorDecode(char *query, size_t length);
+bool UrlQueryNext(UrlQueryIterator *it, StringView *key, StringView *value);
+
+/**
+ * Decode %XX escapes and '+' in place and return the new length. Invalid
+ * escapes are kept as they are.
+*/
+size_t UrlDecodeInPlace(char *s, size_t length);
+
+#pragma endregion
+#pragma region Encoding
+
+/**
+ * CODEC_PERCENT escapes every byte but letters, digits and "-._~" as %XX.
+ * CODEC_HEX uses lowercase digits. CODEC_BASE64 uses the standard alphabet
+ * with '=' padding, CODEC_BASE64_URL the URL safe alphabet without padding.
+ * Base64 decoding accepts either alphabet, padded or not, and hex decoding
+ * either case.
+*/
+typedef enum Codec {
+  CODEC_PERCENT,
+  CODEC_HEX,
+  CODEC_BASE64,
+  CODEC_BASE64_URL,
+} Codec;
+
+/**
+ * Exact output length, without the NUL terminator. For decoding the length
+ * is exact when the input is valid.
+*/
+size_t EncodedLength(const char *s, size_t length, Codec codec);
+size_t DecodedLength(const char *s, size_t length, Codec codec);
+
+bool  EncodeToBuffer(char *buffer, size_t buffer_size, const char *s, size_t length, Codec codec);
+char* EncodeAlloc(const char *s, size_t length, Codec codec);
+bool  StringBuilderAddEncoded(StringBuilder *sb, const char *s, size_t length, Codec codec);
+
+/**
+ * Decoding fails for invalid hex or base64 input. Invalid percent escapes
+ * are kept as they are.
+*/
+bool  DecodeToBuffer(char *buffer, size_t buffer_size, const char *s, size_t length, Codec codec);
+char* DecodeAlloc(const char *s, size_t length, Codec codec);
+bool  StringBuilderAddDecoded(StringBuilder *sb, const char *s, size_t length, Codec codec);
+
+/**
+ * Encode or decode input that arrives in chunks of any size. Partial groups
+ * are carried over to the next chunk, CodecStreamFinish writes the last one.
+*/
+typedef struct CodecStream {
+  Codec codec;
+  bool decode;
+  bool padded;
+  char carry[4];
+  size_t carry_length;
+} CodecStream;
+
+CodecStream CreateCodecStream(Codec codec, bool decode);
+bool CodecStreamFeed(CodecStream *stream, StringBuilder *sb, const char *chunk, size_t length);
+bool CodecStreamFinish(CodecStream *stream, StringBuilder *sb);
+
 #pragma endregion
 #pragma region Bit Operations
 
@@ -236,6 +903,22 @@ int CharToInt(char c);
 int StringToInt32(const char *s);
 int64_t StringToInt64(const char *s);
 
+/**
+ * Parse a number at the start of the first length bytes of s, which do not
+ * need to be NUL terminated. Whitespace is not skipped. If consumed is not
+ * NULL, it is set to the number of bytes that make up the number.
+ * Returns false when s does not start with a number (consumed is 0) or when
+ * the number does not fit the type (consumed is its length). value is only
+ * written on success.
+ * ParseHex64 accepts an optional 0x prefix. ParseDouble also accepts
+ * inf, infinity and nan.
+*/
+bool ParseInt32(const char *s, size_t length, int32_t *value, size_t *consumed);
+bool ParseInt64(const char *s, size_t length, int64_t *value, size_t *consumed);
+bool ParseUint64(const char *s, size_t length, uint64_t *value, size_t *consumed);
+bool ParseHex64(const char *s, size_t length, uint64_t *value, size_t *consumed);
+bool ParseDouble(const char *s, size_t length, double *value, size_t *consumed);
+
 bool  CharToStringToBuffer(char *buffer, size_t buffer_size, char c);
 char* CharToStringAlloc(char c);
 
@@ -243,28 +926,42 @@ bool Int32ToStringToBuffer(char *buffer, size_t buffer_size, int32_t value, int3
 bool Int64ToStringToBuffer(char *buffer, size_t buffer_size, int64_t value, int32_t base);
 bool Uint64ToStringToBuffer(char *buffer, size_t buffer_size, uint64_t value, int32_t base);
 
+/**
+ * Shortest text that reads back as the same value, like 0.1, 1.5e+300 or
+ * 123. The float version is shortest for the float value. The fixed version
+ * rounds to precision (0 to 99) decimals like printf's %.Nf.
+ * The format functions print these with %f and %.Nf.
+*/
+bool DoubleToStringToBuffer(char *buffer, size_t buffer_size, double value);
+bool FloatToStringToBuffer(char *buffer, size_t buffer_size, float value);
+bool DoubleToFixedStringToBuffer(char *buffer, size_t buffer_size, double value, int32_t precision);
+
 #pragma endregion
 #pragma region Hash map
 
 typedef struct StringHashMapValue {
   char *key, *value;
-  struct StringHashMapValue *next;
+  uint64_t hash;
 } StringHashMapValue;
 
-StringHashMapValue* NewStringHashMapValue(char *key, char *value);
-
+/**
+ * Open addressing hash map from string to string. Keys and values are not
+ * copied. The capacity is a power of two and grows with the number of keys.
+*/
 typedef struct StringHashMap {
   size_t capacity;
   size_t length;
-  StringHashMapValue **items;
+  StringHashMapValue *items;
+  uint64_t seed[2];
 } StringHashMap;
 
 bool AllocateStringHashMap(StringHashMap *hm, size_t capacity);
 bool DeallocateStringHashMap(StringHashMap *hm);
 StringHashMap CreateStringHashMap(size_t capacity);
 
-void  StringHashMapSet(StringHashMap *hm, char *key, char *value);
+bool  StringHashMapSet(StringHashMap *hm, char *key, char *value);
 char* StringHashMapGet(StringHashMap *hm, char *key);
+char* StringHashMapGetView(StringHashMap *hm, StringView key);
 bool  StringHashMapRemove(StringHashMap *hm, char *key);
 
 #pragma endregion
@@ -1,3 +1,9 @@
+// glibc and musl hide POSIX declarations such as fileno under -std=c11. This
+// has to come before the first system header, including those of cutil.h.
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "../include/cutil.h"
 
 // Function naming rules:
@@ -17,7 +23,9 @@
 # References
 
 - Fast int to string: http://www.strudel.org.uk/itoa/
-- djb2 hash: http://www.cse.yorku.ca/~oz/hash.html
+- wyhash: https://github.com/wangyi-fudan/wyhash
+- SipHash: https://www.aumasson.jp/siphash/siphash.pdf
+- Grisu2: https://www.cs.tufts.edu/~nr/cs257/archive/florian-loitsch/printf.pdf
 
 */
 
@@ -27,6 +35,18 @@
 #include <stdarg.h>
 #endif
 
+#ifndef _INC_ERRNO
+#include <errno.h>
+#endif
+
+#ifndef _INC_FLOAT
+#include <float.h>
+#endif
+
+#ifndef _INC_MATH
+#include <math.h>
+#endif
+
 #ifndef _INC_STDIO
 #include <stdio.h>
 #endif
@@ -43,1582 +63,5656 @@
 #include <sys/stat.h>
 #endif
 
-#pragma endregion
-#pragma region Definitions
+#ifndef _INC_TIME
+#include <time.h>
+#endif
 
-#define FREAD_BUFFER_SIZE 4096
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define CUTIL_HAS_GETRANDOM
+#endif
+#endif
+#else
+// NOUSER keeps winuser.h out, its CharUpper/CharLower macros would rename ours.
+#define WIN32_LEAN_AND_MEAN
+#define NOUSER
+#define NOMINMAX
+#include <windows.h>
+#include <bcrypt.h>
+#include <fcntl.h>
+#include <io.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "bcrypt")
+#endif
+#endif
 
 #pragma endregion
-#pragma region Char and String
+#pragma region Definitions
 
-inline bool CharIsAlpha(char c) {
-  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
-}
+#define FREAD_BUFFER_SIZE 4096
+#define LINE_READER_BLOCK_SIZE (256*1024)
+#define OUTPUT_BUFFER_SIZE 4096
+#define ASYNC_LOG_BATCH_SIZE (64*1024)
+#define FLOAT_STRING_SIZE 32
+#define FLOAT_FIXED_STRING_SIZE 416
+#define ARENA_ALIGNMENT 16
+#define STRING_MATCHER_NONE UINT32_MAX
+#define STRING_MATCHER_OUTPUT 0x80000000u
+#define STRING_MATCHER_ROW_MASK 0x7fffffffu
+
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CUTIL_LITTLE_ENDIAN
+#endif
 
-inline bool CharIsDigit(char c) {
-  return '0' <= c && c <= '9';
-}
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
 
-inline bool CharIsUpper(char c) {
-  return 'A' <= c && c <= 'Z';
-}
+#pragma endregion
+#pragma region SIMD
 
-inline bool CharIsLower(char c) {
-  return 'a' <= c && c <= 'z';
-}
+// The kernels below are selected once at runtime from CPUID. Define
+// CUTIL_NO_SIMD to always use the scalar versions.
+//
+// The aligned kernels may read past the terminator of a string, but never
+// across a 16/32 byte boundary, so they can not touch an unmapped page.
+// AddressSanitizer would still report those bytes, so SIMD_OVER_READ leaves
+// the aligned kernels uninstrumented.
+
+#if !defined(CUTIL_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CUTIL_SIMD_X86
+#define SIMD_OVER_READ __attribute__((no_sanitize_address))
+#include <immintrin.h>
+#endif
 
-inline bool CharIn(char c, const char *haystack) {
-  while (*haystack != '\0') {
-    if (c == *haystack++) {
-      return true;
-    }
+// Class bits of every byte, see CharClass. Bytes >= 128 belong to no class.
+static const uint8_t char_classes[256] = {
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  8,  8,  8,  8,  8,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 16, 16, 16, 16, 16, 16,
+  16, 33, 33, 33, 33, 33, 33,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, 16, 16, 16, 16, 16,
+  16, 34, 34, 34, 34, 34, 34,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+   2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2, 16, 16, 16, 16,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static size_t StringLengthScalar(const char *s) {
+  const char *p = s;
+  while (*p != '\0') {
+    p++;
   }
-  return false;
-}
-
-inline char CharUpper(char c) {
-  return CharIsLower(c) ? c - 32 : c;
+  return p - s;
 }
 
-inline char CharLower(char c) {
-  return CharIsUpper(c) ? c + 32 : c;
-}
-
-inline size_t StringLength(const char *s) {
-  size_t length = 0;
-  while (*s++ != '\0') {
-    length += 1;
+static const char* StringFindCharScalar(const char *s, char c) {
+  while (*s != c && *s != '\0') {
+    s++;
   }
-  return length;
+  return s;
 }
 
-inline bool StringIsAlpha(const char *s) {
-  while (*s != '\0') {
-    if (!CharIsAlpha(*s)) {
-      return false;
+static const char* MemoryFindCharScalar(const char *s, size_t length, char c) {
+  for (size_t i = 0; i < length; i++) {
+    if (s[i] == c) {
+      return s + i;
     }
-    s++;
   }
-  return true;
+  return NULL;
 }
 
-inline bool StringIsNumeric(const char *s) {
-  while (*s != '\0') {
-    if (!CharIsDigit(*s)) {
-      return false;
+static const char* MemoryFindLastCharScalar(const char *s, size_t length, char c) {
+  while (length > 0) {
+    if (s[--length] == c) {
+      return s + length;
     }
-    s++;
   }
-  return true;
+  return NULL;
 }
 
-inline bool StringIsAlphaNumeric(const char *s) {
-  while (*s != '\0') {
-    if (!CharIsAlpha(*s) && !CharIsDigit(*s)) {
-      return false;
+static const char* MemoryFindPairScalar(const char *s, size_t length, char first, char last, size_t distance) {
+  for (size_t i = 0; i < length; i++) {
+    if (s[i] == first && s[i + distance] == last) {
+      return s + i;
     }
-    s++;
   }
-  return true;
+  return NULL;
 }
 
-inline bool StringUpperToBuffer(char *buffer, size_t buffer_size, const char *s) {
-  while (*s != '\0') {
-    if (--buffer_size == 0) {
-      return false;
+static const char* MemoryFindAnyScalar(const char *s, size_t length, const uint8_t *nibbles) {
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = s[i];
+    if (c < 128 && (nibbles[c & 15] >> (c >> 4)) & 1) {
+      return s + i;
     }
-    *buffer++ = *s - ('a' <= *s && *s <= 'z') * 32;
-    s++;
   }
-  return true;
+  return NULL;
 }
 
-inline char* StringUpperAlloc(const char *s) {
-  StringBuilder sb = CreateDynamicStringBuilder(StringLength(s) + 1);
-  while (*s != '\0') {
-    StringBuilderAddChar(&sb, *s - ('a' <= *s && *s <= 'z') * 32);
-    s++;
+static void MemoryFlipCaseScalar(char *out, const char *s, size_t length, char first) {
+  for (size_t i = 0; i < length; i++) {
+    out[i] = s[i] ^ ((unsigned char)(s[i] - first) < 26) << 5;
   }
-  return sb.string;
 }
 
-inline bool StringLowerToBuffer(char *buffer, size_t buffer_size, const char *s) {
-  while (*s != '\0') {
-    if (--buffer_size == 0) {
-      return false;
+static size_t MemorySpanClassScalar(const char *s, size_t length, uint8_t classes) {
+  for (size_t i = 0; i < length; i++) {
+    if ((char_classes[(unsigned char)s[i]] & classes) == 0) {
+      return i;
     }
-    *buffer++ = *s + ('A' <= *s && *s <= 'Z') * 32;
-    s++;
   }
-  return true;
+  return length;
 }
 
-inline char* StringLowerAlloc(const char *s) {
-  StringBuilder sb = CreateDynamicStringBuilder(StringLength(s) + 1);
-  while (*s != '\0') {
-    StringBuilderAddChar(&sb, *s + ('A' <= *s && *s <= 'Z') * 32);
-    s++;
-  }
-  return sb.string;
+// ASCII lowercase, used to compare without case.
+static unsigned char FoldCase(char c) {
+  return c + ((unsigned char)(c - 'A') < 26) * 32;
 }
 
-inline bool StringTitleToBuffer(char *buffer, size_t buffer_size, const char *s) {
-  bool title = true;
-  while (*s != '\0') {
-    if (--buffer_size == 0) {
-      return false;
-    }
-    char c = *s;
-    if (!CharIsAlpha(c)) {
-      title = true;
-    }
-    else if (CharIsLower(c)) {
-      if (title) {
-        c = CharUpper(c);
-        title = false;
-      }
+static size_t MemoryMismatchFoldScalar(const char *a, const char *b, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (FoldCase(a[i]) != FoldCase(b[i])) {
+      return i;
     }
-    *buffer++ = c;
-    s++;
   }
-  return true;
+  return length;
 }
 
-inline void StringTitleInPlace(char *s) {
-  bool title = true;
-  while (*s != '\0') {
-    char c = *s;
-    if (!CharIsAlpha(c)) {
-      title = true;
-    }
-    else if (CharIsLower(c)) {
-      if (title) {
-        c = CharUpper(c);
-        title = false;
-      }
-    }
-    *s = c;
-    s++;
+static uint64_t MemoryMatchAnyScalar(const char *s, const uint8_t *nibbles) {
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; i++) {
+    unsigned char c = s[i];
+    mask |= (uint64_t)(c < 128 && (nibbles[c & 15] >> (c >> 4)) & 1) << i;
   }
+  return mask;
 }
 
-inline char* StringTitleAlloc(const char *s) {
-  StringBuilder sb = CreateDynamicStringBuilder(StringLength(s) + 1);
-  bool title = true;
-  while (*s != '\0') {
-    char c = *s;
-    if (!CharIsAlpha(c)) {
-      title = true;
-    }
-    else if (CharIsLower(c)) {
-      if (title) {
-        c = CharUpper(c);
-        title = false;
-      }
+#ifdef CUTIL_SIMD_X86
+
+__attribute__((target("sse2")))
+SIMD_OVER_READ
+static size_t StringLengthSse2(const char *s) {
+  const __m128i zero = _mm_setzero_si128();
+  uintptr_t offset = (uintptr_t)s & 15;
+  const __m128i *p = (const __m128i*)(s - offset);
+  uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero)) >> offset;
+  if (mask != 0) {
+    return __builtin_ctz(mask);
+  }
+  while (true) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(++p), zero));
+    if (mask != 0) {
+      return (const char*)p - s + __builtin_ctz(mask);
     }
-    StringBuilderAddChar(&sb, c);
-    s++;
   }
-  return sb.string;
 }
 
-inline bool StringConcatToBuffer(char *buffer, size_t buffer_size, const char *s1, const char *s2) {
-  while (*s1 != '\0') {
-    if (--buffer_size == 0) {
-      return false;
-    }
-    *buffer++ = *s1++;
+__attribute__((target("avx2")))
+SIMD_OVER_READ
+static size_t StringLengthAvx2(const char *s) {
+  const __m256i zero = _mm256_setzero_si256();
+  uintptr_t offset = (uintptr_t)s & 31;
+  const __m256i *p = (const __m256i*)(s - offset);
+  uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(p), zero)) >> offset;
+  if (mask != 0) {
+    return __builtin_ctz(mask);
   }
-  while (*s2 != '\0') {
-    if (--buffer_size == 0) {
-      return false;
+  while (true) {
+    mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(++p), zero));
+    if (mask != 0) {
+      return (const char*)p - s + __builtin_ctz(mask);
     }
-    *buffer++ = *s2++;
   }
-  return true;
 }
 
-inline char* StringConcatAlloc(const char *s1, const char *s2) {
-  StringBuilder sb = CreateDynamicStringBuilder(StringLength(s1) + StringLength(s2) + 1);
-  while (*s1 != '\0') {
-    StringBuilderAddChar(&sb, *s1++);
+__attribute__((target("sse2")))
+SIMD_OVER_READ
+static const char* StringFindCharSse2(const char *s, char c) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i needle = _mm_set1_epi8(c);
+  uintptr_t offset = (uintptr_t)s & 15;
+  const __m128i *p = (const __m128i*)(s - offset);
+  __m128i chunk = _mm_load_si128(p);
+  uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, zero), _mm_cmpeq_epi8(chunk, needle))) >> offset;
+  if (mask != 0) {
+    return s + __builtin_ctz(mask);
   }
-  while (*s2 != '\0') {
-    StringBuilderAddChar(&sb, *s2++);
+  while (true) {
+    chunk = _mm_load_si128(++p);
+    mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, zero), _mm_cmpeq_epi8(chunk, needle)));
+    if (mask != 0) {
+      return (const char*)p + __builtin_ctz(mask);
+    }
   }
-  return sb.string;
 }
 
-inline bool StringSliceToBuffer(char *buffer, size_t buffer_size, const char *s, int64_t start, int64_t end) {
-  if (start < end) {
-    while (start < end && s[start] != '\0') {
-      if (--buffer_size == 0) {
-        return false;
-      }
-      *buffer++ = s[start++];
-    }
+__attribute__((target("avx2")))
+SIMD_OVER_READ
+static const char* StringFindCharAvx2(const char *s, char c) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i needle = _mm256_set1_epi8(c);
+  uintptr_t offset = (uintptr_t)s & 31;
+  const __m256i *p = (const __m256i*)(s - offset);
+  __m256i chunk = _mm256_load_si256(p);
+  uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, zero), _mm256_cmpeq_epi8(chunk, needle))) >> offset;
+  if (mask != 0) {
+    return s + __builtin_ctz(mask);
   }
-  else if (start > end) {
-    while (start > end && start >= 0) {
-      if (--buffer_size == 0) {
-        return false;
-      }
-      *buffer++ = s[start--];
+  while (true) {
+    chunk = _mm256_load_si256(++p);
+    mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, zero), _mm256_cmpeq_epi8(chunk, needle)));
+    if (mask != 0) {
+      return (const char*)p + __builtin_ctz(mask);
     }
   }
-  return true;
 }
 
-inline char* StringSliceAlloc(const char *s, int64_t start, int64_t end) {
-  StringBuilder sb = CreateDynamicStringBuilder(0);
-  if (start < end) {
-    while (start < end && s[start] != '\0') {
-      StringBuilderAddChar(&sb, s[start++]);
+__attribute__((target("sse2")))
+static const char* MemoryFindCharSse2(const char *s, size_t length, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), needle));
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
     }
   }
-  else if (start > end) {
-    while (start > end && start >= 0) {
-      StringBuilderAddChar(&sb, s[start--]);
+  return MemoryFindCharScalar(s + i, length - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char* MemoryFindCharAvx2(const char *s, size_t length, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), needle));
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
     }
   }
-  return sb.string;
+  return MemoryFindCharScalar(s + i, length - i, c);
 }
 
-inline bool StringFirstNCharsToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
-  while (n-- && *s != '\0') {
-    if (--buffer_size == 0) {
-      return false;
+__attribute__((target("sse2")))
+static const char* MemoryFindLastCharSse2(const char *s, size_t length, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  while (length >= 16) {
+    length -= 16;
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + length)), needle));
+    if (mask != 0) {
+      return s + length + 31 - __builtin_clz(mask);
     }
-    *buffer++ = *s++;
   }
-  return true;
+  return MemoryFindLastCharScalar(s, length, c);
 }
 
-inline char* StringFirstNCharsAlloc(const char *s, uint64_t n) {
-  StringBuilder sb = CreateDynamicStringBuilder(n + 1);
-  while (n-- && *s != '\0') {
-    StringBuilderAddChar(&sb, *s++);
+__attribute__((target("avx2")))
+static const char* MemoryFindLastCharAvx2(const char *s, size_t length, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  while (length >= 32) {
+    length -= 32;
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + length)), needle));
+    if (mask != 0) {
+      return s + length + 31 - __builtin_clz(mask);
+    }
   }
-  return sb.string;
+  return MemoryFindLastCharScalar(s, length, c);
 }
 
-inline bool StringLastNCharsToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
-  return StringFirstNCharsToBuffer(buffer, buffer_size,s + StringLength(s) - n, n);
+__attribute__((target("sse2")))
+static const char* MemoryFindPairSse2(const char *s, size_t length, char first, char last, size_t distance) {
+  const __m128i f = _mm_set1_epi8(first);
+  const __m128i l = _mm_set1_epi8(last);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), f);
+    __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i + distance)), l);
+    uint32_t mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
+    }
+  }
+  return MemoryFindPairScalar(s + i, length - i, first, last, distance);
 }
 
-inline char* StringLastNCharsAlloc(const char *s, uint64_t n) {
-  return StringFirstNCharsAlloc(s + StringLength(s) - n, n);
+__attribute__((target("avx2")))
+static const char* MemoryFindPairAvx2(const char *s, size_t length, char first, char last, size_t distance) {
+  const __m256i f = _mm256_set1_epi8(first);
+  const __m256i l = _mm256_set1_epi8(last);
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), f);
+    __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i + distance)), l);
+    uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(a, b));
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
+    }
+  }
+  return MemoryFindPairScalar(s + i, length - i, first, last, distance);
 }
 
-inline bool StringReverseToBuffer(char *buffer, size_t buffer_size, const char *s) {
-  size_t i = StringLength(s);
-  if (i > 0) {
-    do {
-      if (--buffer_size == 0) {
-        return false;
-      }
-      *buffer++ = s[--i];
-    } while (i > 0);
+// ASCII ranges are all below 128, so signed byte compares are exact and
+// bytes >= 128 (negative) never fall in a range.
+#define SIMD_IN_RANGE_SSE2(x, first, last) _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((first) - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8((last) + 1)))
+#define SIMD_IN_RANGE_AVX2(x, first, last) _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8((first) - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8((last) + 1), x))
+
+__attribute__((target("sse2")))
+static void MemoryFlipCaseSse2(char *out, const char *s, size_t length, char first) {
+  const __m128i bit = _mm_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(x, _mm_and_si128(SIMD_IN_RANGE_SSE2(x, first, first + 25), bit)));
   }
-  return true;
+  MemoryFlipCaseScalar(out + i, s + i, length - i, first);
 }
 
-inline char* StringReverseAlloc(const char *s) {
-  size_t i = StringLength(s);
-  StringBuilder sb = {0};
-  if (i > 0) {
-    sb = CreateDynamicStringBuilder(i + 1);
-    do {
-      StringBuilderAddChar(&sb, s[--i]);
-    } while (i > 0);
+__attribute__((target("avx2")))
+static void MemoryFlipCaseAvx2(char *out, const char *s, size_t length, char first) {
+  const __m256i bit = _mm256_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(s + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(x, _mm256_and_si256(SIMD_IN_RANGE_AVX2(x, first, first + 25), bit)));
   }
-  return sb.string;
+  MemoryFlipCaseScalar(out + i, s + i, length - i, first);
 }
 
-inline bool StringReplaceToBuffer(char *buffer, size_t buffer_size, const char *s, const char *search, const char *replace) {
-  size_t search_length = StringLength(search);
-  size_t replace_length = StringLength(replace);
-  while (*s != '\0') {
-    if (StringStartsWith(s, search)) {
-      if (buffer_size < replace_length || (buffer_size -= replace_length) == 0) {
-        return false;
-      }
-      for (size_t i = 0; i < replace_length; i++) {
-        *buffer++ = replace[i];
-      }
-      s += search_length;
-    } else {
-      if (--buffer_size == 0) {
-        return false;
-      }
-      *buffer++ = *s++;
+__attribute__((target("sse2")))
+static size_t MemoryMismatchFoldSse2(const char *a, const char *b, size_t length) {
+  const __m128i bit = _mm_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    x = _mm_or_si128(x, _mm_and_si128(SIMD_IN_RANGE_SSE2(x, 'A', 'Z'), bit));
+    y = _mm_or_si128(y, _mm_and_si128(SIMD_IN_RANGE_SSE2(y, 'A', 'Z'), bit));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-  return true;
+  return i + MemoryMismatchFoldScalar(a + i, b + i, length - i);
 }
 
-inline char* StringReplaceAlloc(const char *s, const char *search, const char *replace) {
-  size_t search_length = StringLength(search);
-  StringBuilder sb = CreateDynamicStringBuilder(0);
-  while (*s != '\0') {
-    if (StringStartsWith(s, search)) {
-      StringBuilderAddString(&sb, replace);
-      s += search_length;
-    } else {
-      StringBuilderAddChar(&sb, *s++);
+__attribute__((target("avx2")))
+static size_t MemoryMismatchFoldAvx2(const char *a, const char *b, size_t length) {
+  const __m256i bit = _mm256_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    x = _mm256_or_si256(x, _mm256_and_si256(SIMD_IN_RANGE_AVX2(x, 'A', 'Z'), bit));
+    y = _mm256_or_si256(y, _mm256_and_si256(SIMD_IN_RANGE_AVX2(y, 'A', 'Z'), bit));
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-  return sb.string;
+  return i + MemoryMismatchFoldScalar(a + i, b + i, length - i);
 }
 
-inline bool StringRepeatToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
-  size_t length = StringLength(s);
-  if (length * n > buffer_size - 1) {
-    return false;
+__attribute__((target("sse2")))
+static __m128i ClassMaskSse2(__m128i x, uint8_t classes) {
+  __m128i folded = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  __m128i digit = SIMD_IN_RANGE_SSE2(x, '0', '9');
+  __m128i m = _mm_setzero_si128();
+  if ((classes & CHAR_CLASS_ALPHA) == CHAR_CLASS_ALPHA) {
+    m = SIMD_IN_RANGE_SSE2(folded, 'a', 'z');
   }
-  while (n--) {
-    for (size_t i = 0; i < StringLength(s); i++) {
-      *buffer++ = s[i];
-    }
+  else if (classes & CHAR_CLASS_UPPER) {
+    m = SIMD_IN_RANGE_SSE2(x, 'A', 'Z');
   }
-  return true;
+  else if (classes & CHAR_CLASS_LOWER) {
+    m = SIMD_IN_RANGE_SSE2(x, 'a', 'z');
+  }
+  if (classes & (CHAR_CLASS_DIGIT | CHAR_CLASS_HEX)) {
+    m = _mm_or_si128(m, digit);
+  }
+  if (classes & CHAR_CLASS_HEX) {
+    m = _mm_or_si128(m, SIMD_IN_RANGE_SSE2(folded, 'a', 'f'));
+  }
+  if (classes & CHAR_CLASS_SPACE) {
+    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), SIMD_IN_RANGE_SSE2(x, '\t', '\r')));
+  }
+  if (classes & CHAR_CLASS_PUNCT) {
+    __m128i alnum = _mm_or_si128(SIMD_IN_RANGE_SSE2(folded, 'a', 'z'), digit);
+    m = _mm_or_si128(m, _mm_andnot_si128(alnum, SIMD_IN_RANGE_SSE2(x, '!', '~')));
+  }
+  return m;
 }
 
-inline char* StringRepeatAlloc(const char *s, int n) {
-  StringBuilder sb = CreateDynamicStringBuilder(1);
-  while (n--) {
-    StringBuilderAddString(&sb, s);
+__attribute__((target("avx2")))
+static __m256i ClassMaskAvx2(__m256i x, uint8_t classes) {
+  __m256i folded = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+  __m256i digit = SIMD_IN_RANGE_AVX2(x, '0', '9');
+  __m256i m = _mm256_setzero_si256();
+  if ((classes & CHAR_CLASS_ALPHA) == CHAR_CLASS_ALPHA) {
+    m = SIMD_IN_RANGE_AVX2(folded, 'a', 'z');
   }
-  return sb.string;
+  else if (classes & CHAR_CLASS_UPPER) {
+    m = SIMD_IN_RANGE_AVX2(x, 'A', 'Z');
+  }
+  else if (classes & CHAR_CLASS_LOWER) {
+    m = SIMD_IN_RANGE_AVX2(x, 'a', 'z');
+  }
+  if (classes & (CHAR_CLASS_DIGIT | CHAR_CLASS_HEX)) {
+    m = _mm256_or_si256(m, digit);
+  }
+  if (classes & CHAR_CLASS_HEX) {
+    m = _mm256_or_si256(m, SIMD_IN_RANGE_AVX2(folded, 'a', 'f'));
+  }
+  if (classes & CHAR_CLASS_SPACE) {
+    m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), SIMD_IN_RANGE_AVX2(x, '\t', '\r')));
+  }
+  if (classes & CHAR_CLASS_PUNCT) {
+    __m256i alnum = _mm256_or_si256(SIMD_IN_RANGE_AVX2(folded, 'a', 'z'), digit);
+    m = _mm256_or_si256(m, _mm256_andnot_si256(alnum, SIMD_IN_RANGE_AVX2(x, '!', '~')));
+  }
+  return m;
 }
 
-inline bool StringContainsChar(const char *s, char search) {
-  while (*s != '\0') {
-    if (*s++ == search) {
-      return true;
+__attribute__((target("sse2")))
+static size_t MemorySpanClassSse2(const char *s, size_t length, uint8_t classes) {
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    uint32_t mask = _mm_movemask_epi8(ClassMaskSse2(_mm_loadu_si128((const __m128i*)(s + i)), classes)) ^ 0xFFFF;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-  return false;
+  return i + MemorySpanClassScalar(s + i, length - i, classes);
 }
 
-inline bool StringContainsString(const char *s, const char *search) {
-  if (StringLength(s) >= StringLength(search)) {
-    while (*s != '\0') {
-      for (size_t i = 0; search[i] != '\0'; i++) {
-        if (*(s + i) != search[i]) {
-          goto ContinueWhile;
-        }
-      }
-      return true;
-ContinueWhile:
-      s++;
+__attribute__((target("avx2")))
+static size_t MemorySpanClassAvx2(const char *s, size_t length, uint8_t classes) {
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(ClassMaskAvx2(_mm256_loadu_si256((const __m256i*)(s + i)), classes));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-  return false;
+  return i + MemorySpanClassScalar(s + i, length - i, classes);
 }
 
-inline bool StringContainsAny(const char *s, const char *chars) {
-  while (*s != '\0') {
-    for (size_t i = 0; chars[i] != '\0'; i++) {
-      if (*s == chars[i]) {
-        return true;
+__attribute__((target("sse2")))
+static size_t HexEncodeBlocksSse2(char *out, const char *s, size_t length) {
+  const __m128i low = _mm_set1_epi8(15);
+  const __m128i nine = _mm_set1_epi8(9);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(x, 4), low);
+    __m128i low_nibbles = _mm_and_si128(x, low);
+    high_nibbles = _mm_add_epi8(_mm_add_epi8(high_nibbles, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(high_nibbles, nine), _mm_set1_epi8('a' - '0' - 10)));
+    low_nibbles = _mm_add_epi8(_mm_add_epi8(low_nibbles, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(low_nibbles, nine), _mm_set1_epi8('a' - '0' - 10)));
+    _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(high_nibbles, low_nibbles));
+    _mm_storeu_si128((__m128i*)(out + 2 * i + 16), _mm_unpackhi_epi8(high_nibbles, low_nibbles));
+  }
+  return i;
+}
+
+// Stops before the first block with a byte that is not a hex digit.
+__attribute__((target("sse2")))
+static size_t HexDecodeBlocksSse2(char *out, const char *s, size_t length) {
+  const __m128i bit = _mm_set1_epi8(0x20);
+  const __m128i low_byte = _mm_set1_epi16(0xFF);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i folded = _mm_or_si128(x, bit);
+    __m128i digit = SIMD_IN_RANGE_SSE2(x, '0', '9');
+    __m128i letter = SIMD_IN_RANGE_SSE2(folded, 'a', 'f');
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+      break;
+    }
+    __m128i values = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(x, _mm_set1_epi8('0'))), _mm_and_si128(letter, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+    __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, low_byte), 4), _mm_srli_epi16(values, 8));
+    _mm_storel_epi64((__m128i*)(out + i / 2), _mm_packus_epi16(pairs, pairs));
+  }
+  return i;
+}
+
+// Mula's method: each 3 byte group is spread over a 32 bit lane, the four
+// 6 bit indices are moved into place with multiplies, and a pshufb table
+// gives the offset that turns each index into its character.
+__attribute__((target("ssse3")))
+static size_t Base64EncodeBlocksSsse3(char *out, const char *s, size_t length, bool url) {
+  const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, (url ? '-' : '+') - 62, (url ? '_' : '/') - 63, 'A', 0, 0);
+  size_t i = 0, j = 0;
+  for (; i + 16 <= length; i += 12, j += 16) {
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(s + i)), spread);
+    __m128i a = _mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i b = _mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(a, b);
+    __m128i classes = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    classes = _mm_or_si128(classes, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    _mm_storeu_si128((__m128i*)(out + j), _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, classes)));
+  }
+  return i;
+}
+
+// The reverse of the encoder, also after Mula. '-' and '_' are folded onto
+// '+' and '/' so both alphabets share the tables. A byte is valid when the
+// classes of its low and high nibble have no bit in common, and the high
+// nibble picks the offset back to its 6 bit value. Writes exactly 12 bytes
+// per 16 characters, so out may be s. Stops before the first invalid block.
+__attribute__((target("ssse3")))
+static size_t Base64DecodeBlocksSsse3(char *out, const char *s, size_t length) {
+  const __m128i low_classes = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i high_classes = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i offsets = _mm_setr_epi8(0, 63 - '/', 62 - '+', 52 - '0', -'A', -'A', 26 - 'a', 26 - 'a', 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m128i low = _mm_set1_epi8(15);
+  size_t i = 0, j = 0;
+  for (; i + 16 <= length; i += 16, j += 12) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i minus = _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('-')), _mm_set1_epi8('-' - '+'));
+    __m128i underscore = _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('_')), _mm_set1_epi8('_' - '/'));
+    x = _mm_sub_epi8(x, _mm_or_si128(minus, underscore));
+    __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(x, 4), low);
+    __m128i classes = _mm_and_si128(_mm_shuffle_epi8(low_classes, _mm_and_si128(x, low)), _mm_shuffle_epi8(high_classes, high_nibbles));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(classes, _mm_setzero_si128())) != 0xFFFF) {
+      break;
+    }
+    // '/' shares its high nibble with '+' and takes the offset one below.
+    __m128i slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('/'));
+    __m128i values = _mm_add_epi8(x, _mm_shuffle_epi8(offsets, _mm_add_epi8(high_nibbles, slash)));
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i groups = _mm_shuffle_epi8(_mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000)), gather);
+    _mm_storel_epi64((__m128i*)(out + j), groups);
+    int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(groups, 8));
+    memcpy(out + j + 8, &last, 4);
+  }
+  return i;
+}
+
+// Each byte looks up the set of high nibbles allowed with its low nibble and
+// tests its own high nibble against it. Bytes >= 128 have no bit to test.
+__attribute__((target("ssse3")))
+static uint32_t MatchAnySsse3(__m128i chunk, __m128i table) {
+  const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i low = _mm_set1_epi8(15);
+  __m128i allowed = _mm_shuffle_epi8(table, _mm_and_si128(chunk, low));
+  __m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(chunk, 4), low));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(allowed, bit), _mm_setzero_si128())) ^ 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+static uint32_t MatchAnyAvx2(__m256i chunk, __m256i table) {
+  const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i low = _mm256_set1_epi8(15);
+  __m256i allowed = _mm256_shuffle_epi8(table, _mm256_and_si256(chunk, low));
+  __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), low));
+  return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(allowed, bit), _mm256_setzero_si256()));
+}
+
+__attribute__((target("ssse3")))
+static const char* MemoryFindAnySsse3(const char *s, size_t length, const uint8_t *nibbles) {
+  const __m128i table = _mm_loadu_si128((const __m128i*)nibbles);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    uint32_t mask = MatchAnySsse3(_mm_loadu_si128((const __m128i*)(s + i)), table);
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
+    }
+  }
+  return MemoryFindAnyScalar(s + i, length - i, nibbles);
+}
+
+__attribute__((target("avx2")))
+static const char* MemoryFindAnyAvx2(const char *s, size_t length, const uint8_t *nibbles) {
+  const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibbles));
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    uint32_t mask = MatchAnyAvx2(_mm256_loadu_si256((const __m256i*)(s + i)), table);
+    if (mask != 0) {
+      return s + i + __builtin_ctz(mask);
+    }
+  }
+  return MemoryFindAnyScalar(s + i, length - i, nibbles);
+}
+
+__attribute__((target("ssse3")))
+static uint64_t MemoryMatchAnySsse3(const char *s, const uint8_t *nibbles) {
+  const __m128i table = _mm_loadu_si128((const __m128i*)nibbles);
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; i += 16) {
+    mask |= (uint64_t)MatchAnySsse3(_mm_loadu_si128((const __m128i*)(s + i)), table) << i;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t MemoryMatchAnyAvx2(const char *s, const uint8_t *nibbles) {
+  const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibbles));
+  uint64_t low = MatchAnyAvx2(_mm256_loadu_si256((const __m256i*)s), table);
+  uint64_t high = MatchAnyAvx2(_mm256_loadu_si256((const __m256i*)(s + 32)), table);
+  return low | high << 32;
+}
+
+#endif
+
+// Length of a NUL terminated string.
+static size_t (*StringLengthKernel)(const char *s) = StringLengthScalar;
+// First occurrence of c in s, or the terminator of s. Same as strchrnul.
+static const char* (*StringFindCharKernel)(const char *s, char c) = StringFindCharScalar;
+// First/last occurrence of c in the first length bytes of s, or NULL.
+static const char* (*MemoryFindCharKernel)(const char *s, size_t length, char c) = MemoryFindCharScalar;
+static const char* (*MemoryFindLastCharKernel)(const char *s, size_t length, char c) = MemoryFindLastCharScalar;
+// First i < length with s[i] == first and s[i + distance] == last, or NULL.
+static const char* (*MemoryFindPairKernel)(const char *s, size_t length, char first, char last, size_t distance) = MemoryFindPairScalar;
+// First byte of s in an ASCII set, or NULL. nibbles[c & 15] has bit c >> 4
+// set for every member c.
+static const char* (*MemoryFindAnyKernel)(const char *s, size_t length, const uint8_t *nibbles) = MemoryFindAnyScalar;
+// Bit i set when s[i] is in the set, for the 64 bytes at s.
+static uint64_t (*MemoryMatchAnyKernel)(const char *s, const uint8_t *nibbles) = MemoryMatchAnyScalar;
+// Flip the case of the bytes in [first, first + 25], out may be s.
+static void (*MemoryFlipCaseKernel)(char *out, const char *s, size_t length, char first) = MemoryFlipCaseScalar;
+// Number of leading bytes of s that belong to one of classes.
+static size_t (*MemorySpanClassKernel)(const char *s, size_t length, uint8_t classes) = MemorySpanClassScalar;
+// First i < length where a[i] and b[i] differ ignoring ASCII case, or length.
+static size_t (*MemoryMismatchFoldKernel)(const char *a, const char *b, size_t length) = MemoryMismatchFoldScalar;
+// Codec blocks, NULL without SIMD. They convert whole blocks and return the
+// number of input bytes consumed, the callers finish the rest.
+static size_t (*HexEncodeBlocksKernel)(char *out, const char *s, size_t length) = NULL;
+static size_t (*HexDecodeBlocksKernel)(char *out, const char *s, size_t length) = NULL;
+static size_t (*Base64EncodeBlocksKernel)(char *out, const char *s, size_t length, bool url) = NULL;
+static size_t (*Base64DecodeBlocksKernel)(char *out, const char *s, size_t length) = NULL;
+
+#ifdef CUTIL_SIMD_X86
+
+// The pointers start out scalar and are only written here, while the library
+// is loaded and before any other thread can call into it. Code that runs in
+// an earlier constructor simply gets the scalar kernels.
+__attribute__((constructor))
+static void SimdSelectKernels(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    StringLengthKernel = StringLengthAvx2;
+    StringFindCharKernel = StringFindCharAvx2;
+    MemoryFindCharKernel = MemoryFindCharAvx2;
+    MemoryFindLastCharKernel = MemoryFindLastCharAvx2;
+    MemoryFindPairKernel = MemoryFindPairAvx2;
+    MemoryFindAnyKernel = MemoryFindAnyAvx2;
+    MemoryMatchAnyKernel = MemoryMatchAnyAvx2;
+    MemoryFlipCaseKernel = MemoryFlipCaseAvx2;
+    MemorySpanClassKernel = MemorySpanClassAvx2;
+    MemoryMismatchFoldKernel = MemoryMismatchFoldAvx2;
+    HexEncodeBlocksKernel = HexEncodeBlocksSse2;
+    HexDecodeBlocksKernel = HexDecodeBlocksSse2;
+    Base64EncodeBlocksKernel = Base64EncodeBlocksSsse3;
+    Base64DecodeBlocksKernel = Base64DecodeBlocksSsse3;
+  }
+  else if (__builtin_cpu_supports("sse2")) {
+    StringLengthKernel = StringLengthSse2;
+    StringFindCharKernel = StringFindCharSse2;
+    MemoryFindCharKernel = MemoryFindCharSse2;
+    MemoryFindLastCharKernel = MemoryFindLastCharSse2;
+    MemoryFindPairKernel = MemoryFindPairSse2;
+    MemoryFlipCaseKernel = MemoryFlipCaseSse2;
+    MemorySpanClassKernel = MemorySpanClassSse2;
+    MemoryMismatchFoldKernel = MemoryMismatchFoldSse2;
+    HexEncodeBlocksKernel = HexEncodeBlocksSse2;
+    HexDecodeBlocksKernel = HexDecodeBlocksSse2;
+    if (__builtin_cpu_supports("ssse3")) {
+      MemoryFindAnyKernel = MemoryFindAnySsse3;
+      MemoryMatchAnyKernel = MemoryMatchAnySsse3;
+      Base64EncodeBlocksKernel = Base64EncodeBlocksSsse3;
+      Base64DecodeBlocksKernel = Base64DecodeBlocksSsse3;
+    }
+  }
+}
+
+#endif
+
+#pragma endregion
+#pragma region Allocators
+
+// Every *Alloc function gets its memory from here, so that UseArena can
+// redirect it into an arena for the current thread.
+
+static THREAD_LOCAL Arena *current_arena = NULL;
+
+static void* AllocMemory(size_t size) {
+  return current_arena != NULL ? ArenaAlloc(current_arena, size) : malloc(size);
+}
+
+// Give back memory from AllocMemory. Arena memory is only reclaimed with the
+// arena.
+static void FreeAllocMemory(void *memory) {
+  if (current_arena == NULL) {
+    free(memory);
+  }
+}
+
+#pragma endregion
+#pragma region Char and String
+
+inline bool CharIsClass(char c, CharClass classes) {
+  return (char_classes[(unsigned char)c] & classes) != 0;
+}
+
+inline bool CharIsAlpha(char c) {
+  return CharIsClass(c, CHAR_CLASS_ALPHA);
+}
+
+inline bool CharIsDigit(char c) {
+  return CharIsClass(c, CHAR_CLASS_DIGIT);
+}
+
+inline bool CharIsAlphaNumeric(char c) {
+  return CharIsClass(c, CHAR_CLASS_ALNUM);
+}
+
+inline bool CharIsUpper(char c) {
+  return CharIsClass(c, CHAR_CLASS_UPPER);
+}
+
+inline bool CharIsLower(char c) {
+  return CharIsClass(c, CHAR_CLASS_LOWER);
+}
+
+inline bool CharIsSpace(char c) {
+  return CharIsClass(c, CHAR_CLASS_SPACE);
+}
+
+inline bool CharIsPunct(char c) {
+  return CharIsClass(c, CHAR_CLASS_PUNCT);
+}
+
+inline bool CharIsHexDigit(char c) {
+  return CharIsClass(c, CHAR_CLASS_HEX);
+}
+
+inline bool CharIn(char c, const char *haystack) {
+  return c != '\0' && *StringFindCharKernel(haystack, c) == c;
+}
+
+inline char CharUpper(char c) {
+  return CharIsLower(c) ? c - 32 : c;
+}
+
+inline char CharLower(char c) {
+  return CharIsUpper(c) ? c + 32 : c;
+}
+
+inline size_t StringLength(const char *s) {
+  return StringLengthKernel(s);
+}
+
+inline bool StringIsClass(const char *s, CharClass classes) {
+  size_t length = StringLength(s);
+  return MemorySpanClassKernel(s, length, classes) == length;
+}
+
+inline bool StringIsAlpha(const char *s) {
+  return StringIsClass(s, CHAR_CLASS_ALPHA);
+}
+
+inline bool StringIsNumeric(const char *s) {
+  return StringIsClass(s, CHAR_CLASS_DIGIT);
+}
+
+inline bool StringIsAlphaNumeric(const char *s) {
+  return StringIsClass(s, CHAR_CLASS_ALNUM);
+}
+
+// Case mappings measure s once and then map it straight into the output, so
+// the buffer, alloc and in place variants make one pass after the length.
+static bool StringMapToBuffer(char *buffer, size_t buffer_size, const char *s, void (*map)(char *out, const char *s, size_t length)) {
+  size_t length = StringLength(s);
+  if (length >= buffer_size) {
+    if (buffer_size > 0) {
+      buffer[0] = '\0';
+    }
+    return false;
+  }
+  map(buffer, s, length);
+  buffer[length] = '\0';
+  return true;
+}
+
+static char* StringMapAlloc(const char *s, void (*map)(char *out, const char *s, size_t length)) {
+  size_t length = StringLength(s);
+  char *result = AllocMemory(length + 1);
+  if (result != NULL) {
+    map(result, s, length);
+    result[length] = '\0';
+  }
+  return result;
+}
+
+// out may be s.
+static void StringUpperRun(char *out, const char *s, size_t length) {
+  MemoryFlipCaseKernel(out, s, length, 'a');
+}
+
+static void StringLowerRun(char *out, const char *s, size_t length) {
+  MemoryFlipCaseKernel(out, s, length, 'A');
+}
+
+// A lowercase letter is capitalized when it follows a non-letter, or a run of
+// uppercase letters that follows one.
+static void StringTitleRun(char *out, const char *s, size_t length) {
+  bool title = true;
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    if (!CharIsAlpha(c)) {
+      title = true;
+    }
+    else if (title && CharIsLower(c)) {
+      c -= 32;
+      title = false;
+    }
+    out[i] = c;
+  }
+}
+
+inline bool StringUpperToBuffer(char *buffer, size_t buffer_size, const char *s) {
+  return StringMapToBuffer(buffer, buffer_size, s, StringUpperRun);
+}
+
+inline char* StringUpperAlloc(const char *s) {
+  return StringMapAlloc(s, StringUpperRun);
+}
+
+inline void StringUpperInPlace(char *s) {
+  StringUpperRun(s, s, StringLength(s));
+}
+
+inline bool StringLowerToBuffer(char *buffer, size_t buffer_size, const char *s) {
+  return StringMapToBuffer(buffer, buffer_size, s, StringLowerRun);
+}
+
+inline char* StringLowerAlloc(const char *s) {
+  return StringMapAlloc(s, StringLowerRun);
+}
+
+inline void StringLowerInPlace(char *s) {
+  StringLowerRun(s, s, StringLength(s));
+}
+
+inline bool StringTitleToBuffer(char *buffer, size_t buffer_size, const char *s) {
+  return StringMapToBuffer(buffer, buffer_size, s, StringTitleRun);
+}
+
+inline char* StringTitleAlloc(const char *s) {
+  return StringMapAlloc(s, StringTitleRun);
+}
+
+inline void StringTitleInPlace(char *s) {
+  StringTitleRun(s, s, StringLength(s));
+}
+
+inline bool StringConcatToBuffer(char *buffer, size_t buffer_size, const char *s1, const char *s2) {
+  while (*s1 != '\0') {
+    if (--buffer_size == 0) {
+      return false;
+    }
+    *buffer++ = *s1++;
+  }
+  while (*s2 != '\0') {
+    if (--buffer_size == 0) {
+      return false;
+    }
+    *buffer++ = *s2++;
+  }
+  return true;
+}
+
+inline char* StringConcatAlloc(const char *s1, const char *s2) {
+  size_t s1_length = StringLength(s1), s2_length = StringLength(s2);
+  StringBuilder sb = CreateDynamicStringBuilder(s1_length + s2_length + 1);
+  StringBuilderAddBytes(&sb, s1, s1_length);
+  StringBuilderAddBytes(&sb, s2, s2_length);
+  return sb.string;
+}
+
+inline bool StringSliceToBuffer(char *buffer, size_t buffer_size, const char *s, int64_t start, int64_t end) {
+  if (start < end) {
+    while (start < end && s[start] != '\0') {
+      if (--buffer_size == 0) {
+        return false;
+      }
+      *buffer++ = s[start++];
+    }
+  }
+  else if (start > end) {
+    while (start > end && start >= 0) {
+      if (--buffer_size == 0) {
+        return false;
+      }
+      *buffer++ = s[start--];
+    }
+  }
+  return true;
+}
+
+inline char* StringSliceAlloc(const char *s, int64_t start, int64_t end) {
+  StringBuilder sb = CreateDynamicStringBuilder(0);
+  if (start < end) {
+    while (start < end && s[start] != '\0') {
+      StringBuilderAddChar(&sb, s[start++]);
+    }
+  }
+  else if (start > end) {
+    while (start > end && start >= 0) {
+      StringBuilderAddChar(&sb, s[start--]);
+    }
+  }
+  return sb.string;
+}
+
+inline bool StringFirstNCharsToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
+  while (n-- && *s != '\0') {
+    if (--buffer_size == 0) {
+      return false;
+    }
+    *buffer++ = *s++;
+  }
+  return true;
+}
+
+inline char* StringFirstNCharsAlloc(const char *s, uint64_t n) {
+  size_t length = 0;
+  while (length < n && s[length] != '\0') {
+    length++;
+  }
+  return StringViewAlloc((StringView){s, length});
+}
+
+inline bool StringLastNCharsToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
+  return StringFirstNCharsToBuffer(buffer, buffer_size,s + StringLength(s) - n, n);
+}
+
+inline char* StringLastNCharsAlloc(const char *s, uint64_t n) {
+  return StringFirstNCharsAlloc(s + StringLength(s) - n, n);
+}
+
+inline bool StringReverseToBuffer(char *buffer, size_t buffer_size, const char *s) {
+  size_t i = StringLength(s);
+  if (i > 0) {
+    do {
+      if (--buffer_size == 0) {
+        return false;
+      }
+      *buffer++ = s[--i];
+    } while (i > 0);
+  }
+  return true;
+}
+
+inline char* StringReverseAlloc(const char *s) {
+  size_t i = StringLength(s);
+  StringBuilder sb = {0};
+  if (i > 0) {
+    sb = CreateDynamicStringBuilder(i + 1);
+    do {
+      StringBuilderAddChar(&sb, s[--i]);
+    } while (i > 0);
+  }
+  return sb.string;
+}
+
+// Runs the replacement over s. With out == NULL only the output length is
+// computed, so callers can size the output before writing it.
+static size_t StringReplaceRun(char *out, const char *s, size_t length, const StringSearcher *ss, const char *replace, size_t replace_length) {
+  size_t output_length = 0, i = 0;
+  int64_t k;
+  while ((k = StringSearcherFind(ss, s + i, length - i)) != -1) {
+    if (out != NULL) {
+      memcpy(out + output_length, s + i, k);
+      memcpy(out + output_length + k, replace, replace_length);
+    }
+    output_length += k + replace_length;
+    i += k + ss->length;
+  }
+  if (out != NULL) {
+    memcpy(out + output_length, s + i, length - i);
+  }
+  return output_length + length - i;
+}
+
+inline bool StringReplaceToBuffer(char *buffer, size_t buffer_size, const char *s, const char *search, const char *replace) {
+  size_t length = StringLength(s);
+  size_t replace_length = StringLength(replace);
+  StringSearcher ss = CreateStringSearcher(search);
+  if (ss.length == 0) {
+    if (length >= buffer_size) {
+      return false;
+    }
+    memcpy(buffer, s, length + 1);
+    return true;
+  }
+  if (StringReplaceRun(NULL, s, length, &ss, replace, replace_length) >= buffer_size) {
+    return false;
+  }
+  buffer[StringReplaceRun(buffer, s, length, &ss, replace, replace_length)] = '\0';
+  return true;
+}
+
+inline char* StringReplaceAlloc(const char *s, const char *search, const char *replace) {
+  size_t length = StringLength(s);
+  size_t replace_length = StringLength(replace);
+  StringSearcher ss = CreateStringSearcher(search);
+  if (ss.length == 0) {
+    return StringDuplicate(s);
+  }
+  size_t output_length = ss.length == replace_length ? length : StringReplaceRun(NULL, s, length, &ss, replace, replace_length);
+  char *result = AllocMemory(output_length + 1);
+  if (result == NULL) {
+    return NULL;
+  }
+  StringReplaceRun(result, s, length, &ss, replace, replace_length);
+  result[output_length] = '\0';
+  return result;
+}
+
+// Leftmost-longest replacement driven by an Aho-Corasick matcher of the
+// reversed searches. Scanning a block of s backwards, the longest match
+// reported at a position is the longest search starting there. The block is
+// then replaced greedily from left to right. Each block is scanned once,
+// plus the longest search length past its end, so the cost stays linear and
+// does not depend on the number of pairs.
+typedef struct StringReplaceManyPairs {
+  StringMatcher reversed;
+  const char **replaces;
+  size_t *replace_lengths;
+  uint32_t *longest;
+  size_t block_size;
+  size_t max_search_length;
+} StringReplaceManyPairs;
+
+#define STRING_REPLACE_MANY_BLOCK_SIZE 4096
+
+static bool StringReplaceManyPrepare(StringReplaceManyPairs *pairs, const char **searches, const char **replaces, uint64_t number_of_pairs) {
+  size_t total = 0, max_search_length = 0;
+  for (uint64_t i = 0; i < number_of_pairs; i++) {
+    size_t search_length = StringLength(searches[i]);
+    total += search_length + 1;
+    if (search_length > max_search_length) {
+      max_search_length = search_length;
+    }
+  }
+  size_t block_size = max_search_length > STRING_REPLACE_MANY_BLOCK_SIZE ? max_search_length : STRING_REPLACE_MANY_BLOCK_SIZE;
+  const char **reversed_searches = malloc((number_of_pairs + 1) * sizeof(char*) + total);
+  pairs->replace_lengths = malloc((number_of_pairs + 1) * sizeof(size_t) + block_size * sizeof(uint32_t));
+  if (reversed_searches == NULL || pairs->replace_lengths == NULL) {
+    free(reversed_searches);
+    free(pairs->replace_lengths);
+    return false;
+  }
+  char *p = (char*)(reversed_searches + number_of_pairs + 1);
+  for (uint64_t i = 0; i < number_of_pairs; i++) {
+    size_t search_length = StringLength(searches[i]);
+    reversed_searches[i] = p;
+    for (size_t j = 0; j < search_length; j++) {
+      *p++ = searches[i][search_length - 1 - j];
+    }
+    *p++ = '\0';
+    pairs->replace_lengths[i] = StringLength(replaces[i]);
+  }
+  bool ok = AllocateStringMatcher(&pairs->reversed, reversed_searches, number_of_pairs);
+  free(reversed_searches);
+  if (!ok) {
+    free(pairs->replace_lengths);
+    return false;
+  }
+  pairs->replaces = replaces;
+  pairs->longest = (uint32_t*)(pairs->replace_lengths + number_of_pairs + 1);
+  pairs->block_size = block_size;
+  pairs->max_search_length = max_search_length;
+  return true;
+}
+
+static void StringReplaceManyRelease(StringReplaceManyPairs *pairs) {
+  DeallocateStringMatcher(&pairs->reversed);
+  free(pairs->replace_lengths);
+}
+
+static size_t StringReplaceManyRun(char *out, const char *s, size_t length, const StringReplaceManyPairs *pairs) {
+  const StringMatcher *sm = &pairs->reversed;
+  size_t output_length = 0, copied = 0, i = 0;
+  if (pairs->max_search_length == 0) {
+    if (out != NULL) {
+      memcpy(out, s, length);
+    }
+    return length;
+  }
+  for (size_t block = 0; block < length; block += pairs->block_size) {
+    size_t block_end = length - block > pairs->block_size ? block + pairs->block_size : length;
+    size_t scan_end = length - block_end > pairs->max_search_length - 1 ? block_end + pairs->max_search_length - 1 : length;
+    // Longest search starting at each position of the block, plus one.
+    uint32_t row = 0;
+    for (size_t j = scan_end; j-- > block;) {
+      row = sm->transitions[(row & STRING_MATCHER_ROW_MASK) + sm->classes[(unsigned char)s[j]]];
+      if (j >= block_end) {
+        continue;
+      }
+      uint32_t match = 0;
+      if (row & STRING_MATCHER_OUTPUT) {
+        uint32_t state = (row & STRING_MATCHER_ROW_MASK) / sm->number_of_classes;
+        match = sm->matches[state] != 0 ? sm->matches[state] : sm->matches[sm->links[state]];
+      }
+      pairs->longest[j - block] = match;
+    }
+    for (; i < block_end; i++) {
+      uint32_t match = pairs->longest[i - block];
+      if (match == 0) {
+        continue;
+      }
+      if (out != NULL) {
+        memcpy(out + output_length, s + copied, i - copied);
+        memcpy(out + output_length + i - copied, pairs->replaces[match - 1], pairs->replace_lengths[match - 1]);
+      }
+      output_length += i - copied + pairs->replace_lengths[match - 1];
+      copied = i + sm->lengths[match - 1];
+      if (copied >= block_end) {
+        i = copied;
+        break;
+      }
+      i = copied - 1;
+    }
+  }
+  if (out != NULL) {
+    memcpy(out + output_length, s + copied, length - copied);
+  }
+  return output_length + length - copied;
+}
+
+inline bool StringReplaceManyToBuffer(char *buffer, size_t buffer_size, const char *s, const char **searches, const char **replaces, uint64_t number_of_pairs) {
+  StringReplaceManyPairs pairs;
+  if (!StringReplaceManyPrepare(&pairs, searches, replaces, number_of_pairs)) {
+    return false;
+  }
+  size_t length = StringLength(s);
+  bool fits = StringReplaceManyRun(NULL, s, length, &pairs) < buffer_size;
+  if (fits) {
+    buffer[StringReplaceManyRun(buffer, s, length, &pairs)] = '\0';
+  }
+  StringReplaceManyRelease(&pairs);
+  return fits;
+}
+
+inline char* StringReplaceManyAlloc(const char *s, const char **searches, const char **replaces, uint64_t number_of_pairs) {
+  StringReplaceManyPairs pairs;
+  if (!StringReplaceManyPrepare(&pairs, searches, replaces, number_of_pairs)) {
+    return NULL;
+  }
+  size_t length = StringLength(s);
+  size_t output_length = StringReplaceManyRun(NULL, s, length, &pairs);
+  char *result = AllocMemory(output_length + 1);
+  if (result != NULL) {
+    StringReplaceManyRun(result, s, length, &pairs);
+    result[output_length] = '\0';
+  }
+  StringReplaceManyRelease(&pairs);
+  return result;
+}
+
+inline bool StringRepeatToBuffer(char *buffer, size_t buffer_size, const char *s, uint64_t n) {
+  size_t length = StringLength(s);
+  if (length * n > buffer_size - 1) {
+    return false;
+  }
+  while (n--) {
+    for (size_t i = 0; i < StringLength(s); i++) {
+      *buffer++ = s[i];
+    }
+  }
+  return true;
+}
+
+inline char* StringRepeatAlloc(const char *s, int n) {
+  size_t length = StringLength(s);
+  StringBuilder sb = CreateDynamicStringBuilder(n > 0 ? length * n + 1 : 1);
+  while (n-- > 0) {
+    StringBuilderAddBytes(&sb, s, length);
+  }
+  return sb.string;
+}
+
+inline bool StringContainsChar(const char *s, char search) {
+  return search != '\0' && *StringFindCharKernel(s, search) == search;
+}
+
+inline bool StringContainsString(const char *s, const char *search) {
+  return StringFirstIndexOf(s, search) != -1;
+}
+
+inline bool StringContainsAny(const char *s, const char *chars) {
+  if (chars[0] != '\0' && chars[1] == '\0') {
+    return StringContainsChar(s, chars[0]);
+  }
+  CharSet set = CreateCharSet(chars);
+  return StringContainsCharSet(s, &set);
+}
+
+inline bool StringIn(const char *s, const char *haystack, const char *separator) {
+  StringView search = CreateStringView(s), token;
+  StringSplitIterator it = CreateStringSplitIterator(CreateStringView(haystack), separator);
+  while (StringSplitNext(&it, &token)) {
+    if (StringViewEquals(token, search)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool StringEquals(const char *s1, const char *s2) {
+  return strcmp(s1, s2) == 0;
+}
+
+// strncmp stops at the end of s1, so only the prefix is ever read.
+inline bool StringStartsWith(const char *s1, const char *s2) {
+  return strncmp(s1, s2, StringLength(s2)) == 0;
+}
+
+inline bool StringEndsWith(const char *s1, const char *s2) {
+  return StringViewEndsWith(CreateStringView(s1), CreateStringView(s2));
+}
+
+inline int StringCompare(const char *s1, const char *s2) {
+  int result = strcmp(s1, s2);
+  return (result > 0) - (result < 0);
+}
+
+inline bool StringEqualsIgnoreCase(const char *s1, const char *s2) {
+  return StringViewEqualsIgnoreCase(CreateStringView(s1), CreateStringView(s2));
+}
+
+inline bool StringStartsWithIgnoreCase(const char *s1, const char *s2) {
+  size_t s2_length = StringLength(s2);
+  if (memchr(s1, '\0', s2_length) != NULL) {
+    return false;
+  }
+  return MemoryMismatchFoldKernel(s1, s2, s2_length) == s2_length;
+}
+
+inline bool StringEndsWithIgnoreCase(const char *s1, const char *s2) {
+  return StringViewEndsWithIgnoreCase(CreateStringView(s1), CreateStringView(s2));
+}
+
+inline int StringCompareIgnoreCase(const char *s1, const char *s2) {
+  return StringViewCompareIgnoreCase(CreateStringView(s1), CreateStringView(s2));
+}
+
+inline int64_t StringFirstIndexOf(const char *s, const char *search) {
+  if (search[0] != '\0' && search[1] == '\0') {
+    const char *p = StringFindCharKernel(s, search[0]);
+    return *p == '\0' ? -1 : p - s;
+  }
+  if (*s == '\0') {
+    return -1;
+  }
+  StringSearcher ss = CreateStringSearcher(search);
+  return StringSearcherFind(&ss, s, StringLength(s));
+}
+
+inline int64_t StringLastIndexOf(const char *s, const char *search) {
+  size_t length = StringLength(s);
+  if (length == 0) {
+    return -1;
+  }
+  if (search[0] == '\0') {
+    return length - 1;
+  }
+  StringSearcher ss = CreateReverseStringSearcher(search);
+  return StringSearcherFind(&ss, s, length);
+}
+
+inline char* StringDuplicate(const char *s) {
+  size_t size = StringLength(s) + 1;
+  char *result = AllocMemory(size);
+  if (result != NULL) {
+    memcpy(result, s, size);
+  }
+  return result;
+}
+
+// Joins measure each string once and copy it with memcpy, so the cost is
+// linear in the output and the buffer does not need to be cleared first.
+inline bool StringsJoinToBuffer(char *buffer, size_t buffer_size, char **strings, uint64_t number_of_strings, char *separator) {
+  size_t separator_length = StringLength(separator), length = 0;
+  if (buffer_size == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < number_of_strings; i++) {
+    size_t string_length = StringLength(strings[i]);
+    size_t gap = i + 1 < number_of_strings ? separator_length : 0;
+    if (string_length + gap >= buffer_size - length) {
+      buffer[0] = '\0';
+      return false;
+    }
+    memcpy(buffer + length, strings[i], string_length);
+    memcpy(buffer + length + string_length, separator, gap);
+    length += string_length + gap;
+  }
+  buffer[length] = '\0';
+  return true;
+}
+
+inline char* StringsJoinAlloc(char **strings, uint64_t number_of_strings, char *separator) {
+  size_t size = 1;
+  for (size_t i = 0; i < number_of_strings; i++) {
+    size += StringLength(strings[i]);
+  }
+  if (number_of_strings > 1) {
+    size += (number_of_strings - 1) * StringLength(separator);
+  }
+  char *result = AllocMemory(size);
+  if (result != NULL) {
+    StringsJoinToBuffer(result, size, strings, number_of_strings, separator);
+  }
+  return result;
+}
+
+#pragma endregion
+#pragma region String Search
+
+// Two-Way string matching (Crochemore & Perrin) with a Horspool style skip
+// on the last byte of the window. The skip is only taken when no prefix
+// memory is carried over, so the search stays linear in the worst case.
+// Forward searches first run a SIMD filter, see StringSearcherFilter.
+//
+// A reverse searcher runs the same algorithm on the mirrored needle and
+// haystack, which finds the last occurrence without copying anything.
+
+#define STRING_SEARCHER_NEEDLE(ss, i) ((const unsigned char*)(ss)->needle)[(ss)->reverse ? (ss)->length - 1 - (size_t)(i) : (size_t)(i)]
+
+static int64_t StringSearcherMaximalSuffix(const StringSearcher *ss, size_t *period, bool inverted) {
+  int64_t m = ss->length, ms = -1, j = 0, k = 1, p = 1;
+  while (j + k < m) {
+    unsigned char a = STRING_SEARCHER_NEEDLE(ss, j + k);
+    unsigned char b = STRING_SEARCHER_NEEDLE(ss, ms + k);
+    if (inverted ? a > b : a < b) {
+      j += k;
+      k = 1;
+      p = j - ms;
+    }
+    else if (a == b) {
+      if (k != p) {
+        k++;
+      } else {
+        j += p;
+        k = 1;
+      }
+    }
+    else {
+      ms = j++;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ms;
+}
+
+static void StringSearcherInit(StringSearcher *ss, const char *needle, size_t length, bool reverse) {
+  ss->needle = needle;
+  ss->length = length;
+  ss->reverse = reverse;
+  ss->critical = -1;
+  ss->period = 1;
+  ss->periodic = false;
+  if (length < 2) {
+    return;
+  }
+  size_t p, q;
+  int64_t i = StringSearcherMaximalSuffix(ss, &p, false);
+  int64_t j = StringSearcherMaximalSuffix(ss, &q, true);
+  ss->critical = i > j ? i : j;
+  ss->period = i > j ? p : q;
+  ss->periodic = true;
+  for (int64_t k = 0; k <= ss->critical; k++) {
+    if (STRING_SEARCHER_NEEDLE(ss, k) != STRING_SEARCHER_NEEDLE(ss, k + ss->period)) {
+      ss->periodic = false;
+      break;
+    }
+  }
+  if (!ss->periodic) {
+    size_t left = ss->critical + 1, right = length - ss->critical - 1;
+    ss->period = (left > right ? left : right) + 1;
+  }
+  size_t max_shift = length < 255 ? length : 255;
+  memset(ss->shift, (int)max_shift, sizeof(ss->shift));
+  for (size_t k = length - max_shift; k < length; k++) {
+    ss->shift[STRING_SEARCHER_NEEDLE(ss, k)] = (uint8_t)(length - 1 - k);
+  }
+}
+
+#define STRING_SEARCHER_TWO_WAY(HAYSTACK)\
+  const int64_t m = ss->length, ell = ss->critical;\
+  const int64_t per = ss->period;\
+  int64_t j = 0, memory = -1;\
+  while (j <= (int64_t)n - m) {\
+    if (memory < 0) {\
+      uint8_t k = ss->shift[HAYSTACK(j + m - 1)];\
+      if (k != 0) {\
+        j += k;\
+        continue;\
+      }\
+    }\
+    int64_t i = (ell > memory ? ell : memory) + 1;\
+    while (i < m && STRING_SEARCHER_NEEDLE(ss, i) == HAYSTACK(i + j)) {\
+      i++;\
+    }\
+    if (i < m) {\
+      j += i - ell;\
+      memory = -1;\
+      continue;\
+    }\
+    i = ell;\
+    while (i > memory && STRING_SEARCHER_NEEDLE(ss, i) == HAYSTACK(i + j)) {\
+      i--;\
+    }\
+    if (i <= memory) {\
+      return j;\
+    }\
+    j += per;\
+    memory = ss->periodic ? m - per - 1 : -1;\
+  }\
+  return -1;
+
+static int64_t StringSearcherTwoWay(const StringSearcher *ss, const unsigned char *y, size_t n) {
+#define FORWARD(i) y[(i)]
+  STRING_SEARCHER_TWO_WAY(FORWARD)
+#undef FORWARD
+}
+
+static int64_t StringSearcherTwoWayReverse(const StringSearcher *ss, const unsigned char *y, size_t n) {
+#define BACKWARD(i) y[n - 1 - (i)]
+  STRING_SEARCHER_TWO_WAY(BACKWARD)
+#undef BACKWARD
+}
+
+// Candidates are found by comparing the first and last byte of the needle
+// 16/32 windows at a time. When too many candidates fail verification the
+// rest of the haystack is handed over to Two-Way.
+static int64_t StringSearcherFilter(const StringSearcher *ss, const char *s, size_t n) {
+  const char *x = ss->needle;
+  size_t m = ss->length, j = 0, verified = 0;
+  while (true) {
+    const char *p = MemoryFindPairKernel(s + j, n - m + 1 - j, x[0], x[m - 1], m - 1);
+    if (p == NULL) {
+      return -1;
+    }
+    j = p - s;
+    if (memcmp(s + j + 1, x + 1, m - 2) == 0) {
+      return j;
+    }
+    j++;
+    verified += m;
+    if (verified > 4 * j + 256) {
+      int64_t k = StringSearcherTwoWay(ss, (const unsigned char*)s + j, n - j);
+      return k == -1 ? -1 : (int64_t)j + k;
+    }
+  }
+}
+
+inline StringSearcher CreateStringSearcher(const char *needle) {
+  StringSearcher ss;
+  StringSearcherInit(&ss, needle, StringLength(needle), false);
+  return ss;
+}
+
+inline StringSearcher CreateReverseStringSearcher(const char *needle) {
+  StringSearcher ss;
+  StringSearcherInit(&ss, needle, StringLength(needle), true);
+  return ss;
+}
+
+inline int64_t StringSearcherFind(const StringSearcher *ss, const char *s, size_t length) {
+  if (ss->length > length) {
+    return -1;
+  }
+  if (ss->length == 0) {
+    return ss->reverse ? (int64_t)length : 0;
+  }
+  if (ss->length == 1) {
+    const char *p = ss->reverse
+      ? MemoryFindLastCharKernel(s, length, ss->needle[0])
+      : MemoryFindCharKernel(s, length, ss->needle[0]);
+    return p == NULL ? -1 : p - s;
+  }
+  if (ss->reverse) {
+    int64_t j = StringSearcherTwoWayReverse(ss, (const unsigned char*)s, length);
+    return j == -1 ? -1 : (int64_t)(length - ss->length) - j;
+  }
+  return StringSearcherFilter(ss, s, length);
+}
+
+inline CharSet CreateCharSet(const char *chars) {
+  CharSet set = {0};
+  while (*chars != '\0') {
+    unsigned char c = *chars++;
+    set.bits[c >> 6] |= 1ULL << (c & 63);
+  }
+  return set;
+}
+
+inline bool CharSetContains(const CharSet *set, char c) {
+  unsigned char uc = c;
+  return (set->bits[uc >> 6] >> (uc & 63)) & 1;
+}
+
+inline bool StringContainsCharSet(const char *s, const CharSet *set) {
+  while (*s != '\0') {
+    if (CharSetContains(set, *s++)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Aho-Corasick automaton compiled into a full DFA. Bytes that appear in no
+// pattern share one column, so the table has one row per trie node and one
+// column per distinct pattern byte (plus one). Transitions hold the row
+// offset of the next state so the scan loop does no multiplication.
+
+inline bool AllocateStringMatcher(StringMatcher *sm, const char **patterns, uint64_t number_of_patterns) {
+  memset(sm, 0, sizeof(StringMatcher));
+  size_t max_states = 1;
+  bool used[256] = {0};
+  for (uint64_t i = 0; i < number_of_patterns; i++) {
+    for (const unsigned char *p = (const unsigned char*)patterns[i]; *p != '\0'; p++) {
+      used[*p] = true;
+      max_states++;
+    }
+  }
+  sm->number_of_classes = 1;
+  for (size_t c = 0; c < 256; c++) {
+    sm->classes[c] = used[c] ? sm->number_of_classes++ : 0;
+  }
+  const size_t C = sm->number_of_classes;
+  if (max_states > STRING_MATCHER_ROW_MASK / C || number_of_patterns >= UINT32_MAX) {
+    return false;
+  }
+  sm->transitions = malloc(max_states * C * sizeof(uint32_t));
+  sm->matches = calloc(max_states, sizeof(uint32_t));
+  sm->links = calloc(max_states, sizeof(uint32_t));
+  sm->lengths = malloc((number_of_patterns + 1) * sizeof(size_t));
+  if (sm->transitions == NULL || sm->matches == NULL || sm->links == NULL || sm->lengths == NULL) {
+    DeallocateStringMatcher(sm);
+    return false;
+  }
+  memset(sm->transitions, 0xff, C * sizeof(uint32_t));
+  sm->number_of_states = 1;
+  sm->number_of_patterns = number_of_patterns;
+
+  for (uint64_t i = 0; i < number_of_patterns; i++) {
+    const unsigned char *p = (const unsigned char*)patterns[i];
+    uint32_t state = 0;
+    for (; *p != '\0'; p++) {
+      uint32_t *next = &sm->transitions[state * C + sm->classes[*p]];
+      if (*next == STRING_MATCHER_NONE) {
+        *next = sm->number_of_states++;
+        memset(sm->transitions + *next * C, 0xff, C * sizeof(uint32_t));
+      }
+      state = *next;
+    }
+    sm->lengths[i] = (const char*)p - patterns[i];
+    if (state != 0 && sm->matches[state] == 0) {
+      sm->matches[state] = i + 1;
+    }
+  }
+
+  // Breadth first over the trie: fill failure links, turn missing
+  // transitions into the failure state's transitions and chain outputs.
+  uint32_t *failure = calloc(sm->number_of_states, sizeof(uint32_t));
+  uint32_t *queue = malloc(sm->number_of_states * sizeof(uint32_t));
+  if (failure == NULL || queue == NULL) {
+    free(failure);
+    free(queue);
+    DeallocateStringMatcher(sm);
+    return false;
+  }
+  size_t head = 0, tail = 0;
+  for (size_t c = 0; c < C; c++) {
+    if (sm->transitions[c] == STRING_MATCHER_NONE) {
+      sm->transitions[c] = 0;
+    } else {
+      queue[tail++] = sm->transitions[c];
+    }
+  }
+  while (head < tail) {
+    uint32_t state = queue[head++];
+    for (size_t c = 0; c < C; c++) {
+      uint32_t *next = &sm->transitions[state * C + c];
+      uint32_t f = sm->transitions[failure[state] * C + c];
+      if (*next == STRING_MATCHER_NONE) {
+        *next = f;
+      } else {
+        failure[*next] = f;
+        sm->links[*next] = sm->matches[f] != 0 ? f : sm->links[f];
+        queue[tail++] = *next;
+      }
+    }
+  }
+  free(failure);
+  free(queue);
+
+  // Store row offsets and flag the states that report something.
+  for (size_t i = 0; i < sm->number_of_states * C; i++) {
+    uint32_t next = sm->transitions[i];
+    bool output = sm->matches[next] != 0 || sm->links[next] != 0;
+    sm->transitions[i] = next * C | (output ? STRING_MATCHER_OUTPUT : 0);
+  }
+  return true;
+}
+
+inline bool DeallocateStringMatcher(StringMatcher *sm) {
+  if (sm == NULL) {
+    return false;
+  }
+  free(sm->transitions);
+  free(sm->matches);
+  free(sm->links);
+  free(sm->lengths);
+  sm->transitions = NULL;
+  sm->matches = sm->links = NULL;
+  sm->lengths = NULL;
+  sm->number_of_states = 0;
+  sm->number_of_patterns = 0;
+  return true;
+}
+
+inline bool StringMatcherContains(const StringMatcher *sm, const char *s, size_t length) {
+  const uint32_t *transitions = sm->transitions;
+  uint32_t row = 0;
+  for (size_t i = 0; i < length; i++) {
+    row = transitions[(row & STRING_MATCHER_ROW_MASK) + sm->classes[(unsigned char)s[i]]];
+    if (row & STRING_MATCHER_OUTPUT) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool StringMatcherFind(const StringMatcher *sm, const char *s, size_t length, StringMatcherCallback callback, void *context) {
+  StringMatcherStream stream = CreateStringMatcherStream(sm);
+  return StringMatcherStreamFeed(&stream, s, length, callback, context);
+}
+
+inline StringMatcherStream CreateStringMatcherStream(const StringMatcher *sm) {
+  return (StringMatcherStream) {
+    .matcher = sm,
+    .row = 0,
+    .offset = 0,
+  };
+}
+
+inline bool StringMatcherStreamFeed(StringMatcherStream *stream, const char *chunk, size_t length, StringMatcherCallback callback, void *context) {
+  const StringMatcher *sm = stream->matcher;
+  const uint32_t *transitions = sm->transitions;
+  uint32_t row = stream->row;
+  for (size_t i = 0; i < length; i++) {
+    row = transitions[(row & STRING_MATCHER_ROW_MASK) + sm->classes[(unsigned char)chunk[i]]];
+    if (!(row & STRING_MATCHER_OUTPUT)) {
+      continue;
+    }
+    uint64_t end = stream->offset + i + 1;
+    for (uint32_t state = (row & STRING_MATCHER_ROW_MASK) / sm->number_of_classes; state != 0; state = sm->links[state]) {
+      uint32_t match = sm->matches[state];
+      if (match != 0 && !callback(context, match - 1, end - sm->lengths[match - 1], end)) {
+        stream->row = row;
+        stream->offset = end;
+        return false;
+      }
+    }
+  }
+  stream->row = row;
+  stream->offset += length;
+  return true;
+}
+
+#pragma endregion
+#pragma region String View
+
+inline StringView CreateStringView(const char *s) {
+  return (StringView){s, StringLength(s)};
+}
+
+inline StringView StringViewSlice(StringView sv, size_t start, size_t end) {
+  if (end > sv.len) {
+    end = sv.len;
+  }
+  if (start > end) {
+    start = end;
+  }
+  return (StringView){sv.ptr + start, end - start};
+}
+
+inline StringView StringViewFirstN(StringView sv, size_t n) {
+  return (StringView){sv.ptr, n < sv.len ? n : sv.len};
+}
+
+inline StringView StringViewLastN(StringView sv, size_t n) {
+  size_t len = n < sv.len ? n : sv.len;
+  return (StringView){sv.ptr + sv.len - len, len};
+}
+
+inline StringView StringViewTrimLeft(StringView sv) {
+  while (sv.len > 0 && CharIsSpace(*sv.ptr)) {
+    sv.ptr++;
+    sv.len--;
+  }
+  return sv;
+}
+
+inline StringView StringViewTrimRight(StringView sv) {
+  while (sv.len > 0 && CharIsSpace(sv.ptr[sv.len - 1])) {
+    sv.len--;
+  }
+  return sv;
+}
+
+inline size_t StringViewSpanClass(StringView sv, CharClass classes) {
+  return MemorySpanClassKernel(sv.ptr, sv.len, classes);
+}
+
+inline StringView StringViewTrim(StringView sv) {
+  return StringViewTrimRight(StringViewTrimLeft(sv));
+}
+
+inline bool StringViewCut(StringView sv, char separator, StringView *before, StringView *after) {
+  const char *p = MemoryFindCharKernel(sv.ptr, sv.len, separator);
+  if (p == NULL) {
+    *before = sv;
+    *after = (StringView){sv.ptr + sv.len, 0};
+    return false;
+  }
+  *before = (StringView){sv.ptr, p - sv.ptr};
+  *after = (StringView){p + 1, sv.len - (p - sv.ptr) - 1};
+  return true;
+}
+
+inline int64_t StringViewFindChar(StringView sv, char c) {
+  const char *p = MemoryFindCharKernel(sv.ptr, sv.len, c);
+  return p == NULL ? -1 : p - sv.ptr;
+}
+
+inline int64_t StringViewFindLastChar(StringView sv, char c) {
+  const char *p = MemoryFindLastCharKernel(sv.ptr, sv.len, c);
+  return p == NULL ? -1 : p - sv.ptr;
+}
+
+inline int64_t StringViewFind(StringView sv, StringView search) {
+  StringSearcher ss;
+  StringSearcherInit(&ss, search.ptr, search.len, false);
+  return StringSearcherFind(&ss, sv.ptr, sv.len);
+}
+
+inline int64_t StringViewFindLast(StringView sv, StringView search) {
+  StringSearcher ss;
+  StringSearcherInit(&ss, search.ptr, search.len, true);
+  return StringSearcherFind(&ss, sv.ptr, sv.len);
+}
+
+inline bool StringViewEquals(StringView a, StringView b) {
+  return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+}
+
+inline int StringViewCompare(StringView a, StringView b) {
+  int result = memcmp(a.ptr, b.ptr, a.len < b.len ? a.len : b.len);
+  if (result != 0) {
+    return result < 0 ? -1 : 1;
+  }
+  return (a.len > b.len) - (a.len < b.len);
+}
+
+inline bool StringViewStartsWith(StringView sv, StringView prefix) {
+  return prefix.len <= sv.len && memcmp(sv.ptr, prefix.ptr, prefix.len) == 0;
+}
+
+inline bool StringViewEndsWith(StringView sv, StringView suffix) {
+  return suffix.len <= sv.len && memcmp(sv.ptr + sv.len - suffix.len, suffix.ptr, suffix.len) == 0;
+}
+
+inline bool StringViewEqualsIgnoreCase(StringView a, StringView b) {
+  return a.len == b.len && MemoryMismatchFoldKernel(a.ptr, b.ptr, a.len) == a.len;
+}
+
+inline int StringViewCompareIgnoreCase(StringView a, StringView b) {
+  size_t length = a.len < b.len ? a.len : b.len;
+  size_t i = MemoryMismatchFoldKernel(a.ptr, b.ptr, length);
+  if (i < length) {
+    return FoldCase(a.ptr[i]) < FoldCase(b.ptr[i]) ? -1 : 1;
+  }
+  return (a.len > b.len) - (a.len < b.len);
+}
+
+inline bool StringViewStartsWithIgnoreCase(StringView sv, StringView prefix) {
+  return prefix.len <= sv.len && MemoryMismatchFoldKernel(sv.ptr, prefix.ptr, prefix.len) == prefix.len;
+}
+
+inline bool StringViewEndsWithIgnoreCase(StringView sv, StringView suffix) {
+  return suffix.len <= sv.len && MemoryMismatchFoldKernel(sv.ptr + sv.len - suffix.len, suffix.ptr, suffix.len) == suffix.len;
+}
+
+inline uint64_t StringViewHash(StringView sv) {
+  return HashBytes(sv.ptr, sv.len, 0);
+}
+
+inline bool StringViewToBuffer(char *buffer, size_t buffer_size, StringView sv) {
+  if (sv.len >= buffer_size) {
+    return false;
+  }
+  if (sv.len > 0) {
+    memcpy(buffer, sv.ptr, sv.len);
+  }
+  buffer[sv.len] = '\0';
+  return true;
+}
+
+inline char* StringViewAlloc(StringView sv) {
+  char *result = AllocMemory(sv.len + 1);
+  if (result != NULL) {
+    memcpy(result, sv.ptr, sv.len);
+    result[sv.len] = '\0';
+  }
+  return result;
+}
+
+inline size_t StringViewsJoinLength(const StringView *views, uint64_t number_of_views, StringView separator) {
+  size_t length = number_of_views > 1 ? (number_of_views - 1) * separator.len : 0;
+  for (size_t i = 0; i < number_of_views; i++) {
+    length += views[i].len;
+  }
+  return length;
+}
+
+inline bool StringViewsJoinToBuffer(char *buffer, size_t buffer_size, const StringView *views, uint64_t number_of_views, StringView separator) {
+  size_t length = StringViewsJoinLength(views, number_of_views, separator);
+  if (length >= buffer_size) {
+    if (buffer_size > 0) {
+      buffer[0] = '\0';
+    }
+    return false;
+  }
+  char *p = buffer;
+  for (size_t i = 0; i < number_of_views; i++) {
+    if (i > 0) {
+      memcpy(p, separator.ptr, separator.len);
+      p += separator.len;
+    }
+    memcpy(p, views[i].ptr, views[i].len);
+    p += views[i].len;
+  }
+  *p = '\0';
+  return true;
+}
+
+inline char* StringViewsJoinAlloc(const StringView *views, uint64_t number_of_views, StringView separator) {
+  size_t size = StringViewsJoinLength(views, number_of_views, separator) + 1;
+  char *result = AllocMemory(size);
+  if (result != NULL) {
+    StringViewsJoinToBuffer(result, size, views, number_of_views, separator);
+  }
+  return result;
+}
+
+#pragma endregion
+#pragma region String Split
+
+static void StringSplitAddNibble(StringSplitIterator *it, unsigned char c) {
+  it->ascii = it->ascii && c < 128;
+  it->nibbles[c & 15] |= 1 << (c >> 4);
+}
+
+inline StringSplitIterator CreateStringSplitIteratorChar(StringView s, char separator) {
+  StringSplitIterator it = {.rest = s, .mode = STRING_SPLIT_CHAR, .ascii = true};
+  it.separator = separator;
+  StringSplitAddNibble(&it, separator);
+  return it;
+}
+
+inline StringSplitIterator CreateStringSplitIterator(StringView s, const char *separator) {
+  size_t length = StringLength(separator);
+  if (length == 1) {
+    return CreateStringSplitIteratorChar(s, separator[0]);
+  }
+  if (length == 0) {
+    return CreateStringSplitIteratorAny(s, "");
+  }
+  StringSplitIterator it = {.rest = s, .mode = STRING_SPLIT_STRING};
+  StringSearcherInit(&it.searcher, separator, length, false);
+  return it;
+}
+
+inline StringSplitIterator CreateStringSplitIteratorAny(StringView s, const char *chars) {
+  StringSplitIterator it = {.rest = s, .mode = STRING_SPLIT_ANY, .ascii = true};
+  it.set = CreateCharSet(chars);
+  while (*chars != '\0') {
+    StringSplitAddNibble(&it, *chars++);
+  }
+  return it;
+}
+
+static const char* StringSplitFindAny(const StringSplitIterator *it) {
+  if (it->ascii) {
+    return MemoryFindAnyKernel(it->rest.ptr, it->rest.len, it->nibbles);
+  }
+  for (size_t i = 0; i < it->rest.len; i++) {
+    if (CharSetContains(&it->set, it->rest.ptr[i])) {
+      return it->rest.ptr + i;
+    }
+  }
+  return NULL;
+}
+
+inline bool StringSplitNext(StringSplitIterator *it, StringView *token) {
+  if (it->done) {
+    return false;
+  }
+  const char *p = NULL;
+  size_t separator_length = 1;
+  switch (it->mode) {
+    case STRING_SPLIT_CHAR:
+      p = MemoryFindCharKernel(it->rest.ptr, it->rest.len, it->separator);
+      break;
+    case STRING_SPLIT_STRING: {
+      int64_t index = StringSearcherFind(&it->searcher, it->rest.ptr, it->rest.len);
+      p = index == -1 ? NULL : it->rest.ptr + index;
+      separator_length = it->searcher.length;
+      break;
+    }
+    case STRING_SPLIT_ANY:
+      p = StringSplitFindAny(it);
+      break;
+  }
+  if (p == NULL) {
+    *token = it->rest;
+    it->done = true;
+    return true;
+  }
+  *token = (StringView){it->rest.ptr, p - it->rest.ptr};
+  it->rest = StringViewSlice(it->rest, token->len + separator_length, it->rest.len);
+  return true;
+}
+
+// Index of the lowest set bit, value must not be 0.
+static int TrailingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(value);
+#else
+  int n = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Single byte separators are matched 64 bytes at a time and every bit of the
+// mask becomes a token, instead of one search call per token.
+inline size_t StringSplitToArray(StringSplitIterator *it, StringView *tokens, size_t max_tokens) {
+  size_t n = 0;
+  if (it->mode != STRING_SPLIT_STRING && it->ascii && !it->done) {
+    const char *s = it->rest.ptr;
+    size_t start = 0;
+    for (size_t i = 0; i + 64 <= it->rest.len && n < max_tokens; i += 64) {
+      uint64_t mask = MemoryMatchAnyKernel(s + i, it->nibbles);
+      while (mask != 0 && n < max_tokens) {
+        size_t end = i + TrailingZeros(mask);
+        tokens[n++] = (StringView){s + start, end - start};
+        start = end + 1;
+        mask &= mask - 1;
+      }
+    }
+    it->rest = StringViewSlice(it->rest, start, it->rest.len);
+  }
+  while (n < max_tokens && StringSplitNext(it, &tokens[n])) {
+    n++;
+  }
+  return n;
+}
+
+#pragma endregion
+#pragma region Format
+
+// One format engine for every printf-like function. A format is a list of
+// segments, either a literal run or a conversion. Segments are parsed on
+// the fly, or once up front into a CompiledFormat. The output goes to a
+// sink. Records for files and descriptors are rendered into a builder first
+// and written with one call.
+
+typedef struct FormatSink FormatSink;
+
+struct FormatSink {
+  bool (*write)(FormatSink *sink, const char *data, size_t length);
+  StringBuilder *sb;
+};
+
+static bool FormatWriteBuilder(FormatSink *sink, const char *data, size_t length) {
+  return StringBuilderAddBytes(sink->sb, data, length);
+}
+
+// Keeps as much as fits in a static builder.
+static bool FormatWriteTruncate(FormatSink *sink, const char *data, size_t length) {
+  StringBuilder *sb = sink->sb;
+  size_t available = sb->capacity - sb->length - 1;
+  bool fits = length <= available;
+  if (!fits) {
+    length = available;
+  }
+  memcpy(sb->string + sb->length, data, length);
+  sb->length += length;
+  sb->string[sb->length] = '\0';
+  return fits;
+}
+
+// Where the format and its arguments come from. The format is either a
+// string or a compiled format, the arguments either varargs or typed.
+typedef struct FormatJob {
+  const char *format;
+  const CompiledFormat *cf;
+  va_list *valist;
+  const FormatArg *args;
+  size_t number_of_args;
+} FormatJob;
+
+static bool FormatIsConversion(char c) {
+  switch (c) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'c':
+    case 's':
+    case 'b':
+    case 'B':
+    case 'f':
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Parses the segment at the start of format and returns the rest. Unknown
+// conversions are kept as literal text.
+static const char* FormatNextSegment(const char *format, FormatSegment *segment) {
+  if (*format == '%') {
+    if (FormatIsConversion(format[1])) {
+      segment->literal = NULL;
+      segment->length = 0;
+      segment->conversion = format[1];
+      segment->precision = -1;
+      return format + 2;
+    }
+    // %.Nf with up to two digits of precision.
+    if (format[1] == '.' && CharIsDigit(format[2])) {
+      size_t digits = CharIsDigit(format[3]) ? 2 : 1;
+      if (format[2 + digits] == 'f') {
+        segment->literal = NULL;
+        segment->length = 0;
+        segment->conversion = 'f';
+        segment->precision = digits == 2 ? (format[2] - '0') * 10 + format[3] - '0' : format[2] - '0';
+        return format + 3 + digits;
+      }
+    }
+    segment->literal = format;
+    segment->length = format[1] == '\0' ? 1 : 2;
+    segment->conversion = 0;
+    segment->precision = -1;
+    return format + segment->length;
+  }
+  const char *end = StringFindCharKernel(format, '%');
+  segment->literal = format;
+  segment->length = end - format;
+  segment->conversion = 0;
+  segment->precision = -1;
+  return end;
+}
+
+static size_t IntegerToStringToBuffer(char *buffer, size_t buffer_size, uint64_t value, bool negative, int32_t base);
+static size_t FloatingToShortest(char *buffer, double value, bool is_float);
+static size_t FloatingToFixed(char *buffer, double value, int precision);
+
+// Writes a %f conversion, shortest round-trip text or fixed precision.
+static bool FormatFloating(FormatSink *sink, double value, bool is_float, int precision) {
+  if (precision < 0) {
+    char buffer[FLOAT_STRING_SIZE];
+    return sink->write(sink, buffer, FloatingToShortest(buffer, value, is_float));
+  }
+  char buffer[FLOAT_FIXED_STRING_SIZE];
+  return sink->write(sink, buffer, FloatingToFixed(buffer, value, precision));
+}
+
+// Writes one conversion. Typed arguments are printed by their own type, a
+// conversion that does not fit the type is an error.
+static bool FormatConversion(FormatSink *sink, const FormatSegment *segment, va_list *valist, const FormatArg *arg) {
+  char buffer[24];
+  const char *s;
+  char conversion = segment->conversion;
+  FormatArgType type = arg != NULL ? arg->type : FORMAT_ARG_INT64;
+  bool is_integer = type == FORMAT_ARG_INT64 || type == FORMAT_ARG_UINT64 || type == FORMAT_ARG_CHAR || type == FORMAT_ARG_BOOL;
+  switch (conversion) {
+    case 'f':
+      if (arg == NULL) {
+        return FormatFloating(sink, va_arg(*valist, double), false, segment->precision);
+      }
+      if (type != FORMAT_ARG_DOUBLE && type != FORMAT_ARG_FLOAT) {
+        return false;
+      }
+      return FormatFloating(sink, arg->d, type == FORMAT_ARG_FLOAT, segment->precision);
+    case 'd':
+    case 'i':
+    case 'u':
+      if (!is_integer) {
+        return false;
+      }
+      if (arg == NULL ? conversion == 'u' : type == FORMAT_ARG_UINT64) {
+        uint64_t value = arg != NULL ? arg->u : va_arg(*valist, uint64_t);
+        return sink->write(sink, buffer, IntegerToStringToBuffer(buffer, ArraySize(buffer), value, false, 10));
+      } else {
+        int64_t value = arg != NULL ? arg->i : va_arg(*valist, int64_t);
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+        return sink->write(sink, buffer, IntegerToStringToBuffer(buffer, ArraySize(buffer), magnitude, value < 0, 10));
+      }
+    case 'c':
+      if (!is_integer) {
+        return false;
+      }
+      buffer[0] = (char)(arg != NULL ? arg->i : va_arg(*valist, int));
+      return sink->write(sink, buffer, 1);
+    case 's':
+      if (arg != NULL && type != FORMAT_ARG_STRING) {
+        return false;
+      }
+      s = arg != NULL ? arg->s : va_arg(*valist, const char*);
+      break;
+    case 'b':
+    case 'B':
+      if (!is_integer) {
+        return false;
+      }
+      if (arg != NULL ? arg->i != 0 : va_arg(*valist, int) != 0) {
+        s = conversion == 'b' ? "true" : "TRUE";
+      } else {
+        s = conversion == 'b' ? "false" : "FALSE";
+      }
+      break;
+    default:
+      return true;
+  }
+  return sink->write(sink, s, StringLength(s));
+}
+
+// Runs one segment, used counts the arguments taken so far.
+static bool FormatSegmentRun(FormatSink *sink, const FormatSegment *segment, va_list *valist, const FormatJob *job, size_t *used) {
+  if (segment->conversion == 0) {
+    return sink->write(sink, segment->literal, segment->length);
+  }
+  if (job->args == NULL) {
+    return FormatConversion(sink, segment, valist, NULL);
+  }
+  if (*used == job->number_of_args) {
+    return false;
+  }
+  return FormatConversion(sink, segment, NULL, &job->args[(*used)++]);
+}
+
+static bool FormatRun(FormatSink *sink, const FormatJob *job) {
+  va_list args;
+  if (job->valist != NULL) {
+    va_copy(args, *job->valist);
+  }
+  bool ok = true;
+  size_t used = 0;
+  if (job->cf != NULL) {
+    for (size_t i = 0; ok && i < job->cf->number_of_segments; i++) {
+      ok = FormatSegmentRun(sink, &job->cf->segments[i], &args, job, &used);
+    }
+  } else {
+    FormatSegment segment;
+    const char *format = job->format;
+    while (ok && *format != '\0') {
+      format = FormatNextSegment(format, &segment);
+      ok = FormatSegmentRun(sink, &segment, &args, job, &used);
+    }
+  }
+  if (job->valist != NULL) {
+    va_end(args);
+  }
+  return ok && used == job->number_of_args;
+}
+
+static bool StringBuilderFormat(StringBuilder *sb, const FormatJob *job) {
+  FormatSink sink = {.write = FormatWriteBuilder, .sb = sb};
+  return FormatRun(&sink, job);
+}
+
+// Formats into the static builder stack, or into heap when the record does
+// not fit. Returns the builder holding the record, or NULL.
+static StringBuilder* FormatRecord(StringBuilder *stack, StringBuilder *heap, const FormatJob *job) {
+  if (StringBuilderFormat(stack, job)) {
+    return stack;
+  }
+  *heap = (StringBuilder){.is_dynamic = true};
+  if (StringBuilderFormat(heap, job)) {
+    return heap;
+  }
+  return NULL;
+}
+
+static bool FormatToBuffer(char *buffer, size_t buffer_size, const FormatJob *job) {
+  if (buffer_size == 0) {
+    return false;
+  }
+  StringBuilder sb = CreateStaticStringBuilder(buffer, buffer_size);
+  FormatSink sink = {.write = FormatWriteTruncate, .sb = &sb};
+  return FormatRun(&sink, job);
+}
+
+static bool FormatAppendToBuffer(char *buffer, size_t buffer_size, const FormatJob *job) {
+  const char *end = MemoryFindCharKernel(buffer, buffer_size, '\0');
+  if (end == NULL) {
+    return false;
+  }
+  StringBuilder sb = {.string = buffer, .capacity = buffer_size, .length = end - buffer};
+  FormatSink sink = {.write = FormatWriteTruncate, .sb = &sb};
+  return FormatRun(&sink, job);
+}
+
+static bool FormatToFd(int fd, const FormatJob *job) {
+  char buffer[OUTPUT_BUFFER_SIZE];
+  StringBuilder stack = CreateStaticStringBuilder(buffer, sizeof(buffer));
+  StringBuilder heap = {0};
+  StringBuilder *record = FormatRecord(&stack, &heap, job);
+  bool ok = record != NULL;
+  for (size_t written = 0; ok && written < record->length;) {
+    int64_t n = write(fd, record->string + written, record->length - written);
+    ok = n > 0;
+    written += ok ? n : 0;
+  }
+  free(heap.string);
+  return ok;
+}
+
+inline bool AllocateCompiledFormat(CompiledFormat *cf, const char *format) {
+  memset(cf, 0, sizeof(CompiledFormat));
+  size_t capacity = 1;
+  for (const char *c = format; *c != '\0'; c++) {
+    capacity += *c == '%';
+  }
+  cf->segments = malloc(2 * capacity * sizeof(FormatSegment));
+  if (cf->segments == NULL) {
+    return false;
+  }
+  while (*format != '\0') {
+    format = FormatNextSegment(format, &cf->segments[cf->number_of_segments++]);
+  }
+  return true;
+}
+
+inline bool DeallocateCompiledFormat(CompiledFormat *cf) {
+  free(cf->segments);
+  memset(cf, 0, sizeof(CompiledFormat));
+  return true;
+}
+
+void Sprintf(char *buffer, size_t buffer_size, const char *format, ...) {
+  va_list valist;
+  va_start(valist, format);
+  FormatToBuffer(buffer, buffer_size, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+}
+
+void Sappendf(char *buffer, size_t buffer_size, const char *format, ...) {
+  va_list valist;
+  va_start(valist, format);
+  FormatAppendToBuffer(buffer, buffer_size, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+}
+
+void SprintfCompiled(char *buffer, size_t buffer_size, const CompiledFormat *cf, ...) {
+  va_list valist;
+  va_start(valist, cf);
+  FormatToBuffer(buffer, buffer_size, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+}
+
+void SappendfCompiled(char *buffer, size_t buffer_size, const CompiledFormat *cf, ...) {
+  va_list valist;
+  va_start(valist, cf);
+  FormatAppendToBuffer(buffer, buffer_size, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+}
+
+bool StringBuilderPrintfCompiled(StringBuilder *sb, const CompiledFormat *cf, ...) {
+  if (sb == NULL) {
+    return false;
+  }
+  va_list valist;
+  va_start(valist, cf);
+  bool ok = StringBuilderFormat(sb, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+  return ok;
+}
+
+bool WriteFormatToFd(int fd, const char *format, ...) {
+  va_list valist;
+  va_start(valist, format);
+  bool ok = FormatToFd(fd, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+  return ok;
+}
+
+bool WriteCompiledFormatToFd(int fd, const CompiledFormat *cf, ...) {
+  va_list valist;
+  va_start(valist, cf);
+  bool ok = FormatToFd(fd, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+  return ok;
+}
+
+inline FormatArg FormatArgInt64(int64_t value) {
+  return (FormatArg){.type = FORMAT_ARG_INT64, .i = value};
+}
+
+inline FormatArg FormatArgUint64(uint64_t value) {
+  return (FormatArg){.type = FORMAT_ARG_UINT64, .u = value};
+}
+
+inline FormatArg FormatArgChar(char value) {
+  return (FormatArg){.type = FORMAT_ARG_CHAR, .i = value};
+}
+
+inline FormatArg FormatArgBool(bool value) {
+  return (FormatArg){.type = FORMAT_ARG_BOOL, .i = value};
+}
+
+inline FormatArg FormatArgString(const char *value) {
+  return (FormatArg){.type = FORMAT_ARG_STRING, .s = value};
+}
+
+inline FormatArg FormatArgDouble(double value) {
+  return (FormatArg){.type = FORMAT_ARG_DOUBLE, .d = value};
+}
+
+inline FormatArg FormatArgFloat(float value) {
+  return (FormatArg){.type = FORMAT_ARG_FLOAT, .d = value};
+}
+
+bool SprintfArgs(char *buffer, size_t buffer_size, const char *format, const FormatArg *args, size_t number_of_args) {
+  FormatJob job = {.format = format, .args = args, .number_of_args = number_of_args};
+  return FormatToBuffer(buffer, buffer_size, &job);
+}
+
+bool SappendfArgs(char *buffer, size_t buffer_size, const char *format, const FormatArg *args, size_t number_of_args) {
+  FormatJob job = {.format = format, .args = args, .number_of_args = number_of_args};
+  return FormatAppendToBuffer(buffer, buffer_size, &job);
+}
+
+bool StringBuilderPrintfArgs(StringBuilder *sb, const char *format, const FormatArg *args, size_t number_of_args) {
+  if (sb == NULL) {
+    return false;
+  }
+  FormatJob job = {.format = format, .args = args, .number_of_args = number_of_args};
+  return StringBuilderFormat(sb, &job);
+}
+
+#pragma endregion
+#pragma region String Builder
+
+// The string of a builder is always NUL terminated at length, so bytes past
+// the terminator are never initialized or cleared.
+
+inline StringBuilder CreateStaticStringBuilder(char *buffer, size_t buffer_size) {
+  if (buffer_size > 0) {
+    buffer[0] = '\0';
+  }
+  return (StringBuilder) {
+    .is_dynamic = false,
+    .capacity = buffer_size,
+    .length = 0,
+    .string = buffer,
+  };
+}
+
+inline StringBuilder CreateDynamicStringBuilder(size_t initial_capacity) {
+  if (initial_capacity == 0) {
+    initial_capacity = 1;
+  }
+  char *string = AllocMemory(initial_capacity);
+  if (string != NULL) {
+    string[0] = '\0';
+  }
+  return (StringBuilder) {
+    .is_dynamic = true,
+    .capacity = string == NULL ? 0 : initial_capacity,
+    .length = 0,
+    .string = string,
+    .arena = current_arena,
+  };
+}
+
+inline bool AllocateStringBuilder(StringBuilder *sb, size_t initial_capacity) {
+  if (DeallocateStringBuilder(sb)) {
+    *sb = CreateDynamicStringBuilder(initial_capacity);
+    return sb->string != NULL;
+  }
+  return false;
+}
+
+inline bool DeallocateStringBuilder(StringBuilder *sb) {
+  if (sb == NULL) {
+    return false;
+  }
+  StringBuilderClear(sb);
+  if (sb->is_dynamic && sb->arena == NULL) {
+    free(sb->string);
+  }
+  return true;
+}
+
+inline bool StringBuilderCapacityRealloc(StringBuilder *sb, size_t padding) {
+  if (sb == NULL || !sb->is_dynamic) {
+    return false;
+  }
+  size_t capacity = sb->capacity > 0 ? sb->capacity : 16;
+  while (sb->length + padding >= capacity) {
+    capacity <<= 1;
+  }
+  char *string = sb->arena != NULL
+    ? ArenaRealloc(sb->arena, sb->string, sb->capacity, capacity)
+    : realloc(sb->string, sizeof(char) * capacity);
+  if (string == NULL) {
+    return false;
+  }
+  if (sb->capacity == 0) {
+    string[0] = '\0';
+  }
+  sb->string = string;
+  sb->capacity = capacity;
+  return true;
+}
+
+inline bool StringBuilderReserve(StringBuilder *sb, size_t additional) {
+  if (sb == NULL) {
+    return false;
+  }
+  if (sb->length + additional < sb->capacity) {
+    return true;
+  }
+  return StringBuilderCapacityRealloc(sb, additional);
+}
+
+inline bool StringBuilderShrinkToFit(StringBuilder *sb) {
+  if (sb == NULL || !sb->is_dynamic) {
+    return false;
+  }
+  if (sb->length + 1 == sb->capacity || sb->arena != NULL) {
+    return true;
+  }
+  char *string = realloc(sb->string, sb->length + 1);
+  if (string == NULL) {
+    return false;
+  }
+  string[sb->length] = '\0';
+  sb->string = string;
+  sb->capacity = sb->length + 1;
+  return true;
+}
+
+inline bool StringBuilderAddChar(StringBuilder *sb, char c) {
+  if (sb == NULL) {
+    return false;
+  }
+  if (sb->length + 1 >= sb->capacity && !StringBuilderCapacityRealloc(sb, 1)) {
+    return false;
+  }
+  sb->string[sb->length++] = c;
+  sb->string[sb->length] = '\0';
+  return true;
+}
+
+inline bool StringBuilderAddBytes(StringBuilder *sb, const char *bytes, size_t length) {
+  if (sb == NULL) {
+    return false;
+  }
+  if (sb->length + length >= sb->capacity && !StringBuilderCapacityRealloc(sb, length)) {
+    return false;
+  }
+  memcpy(sb->string + sb->length, bytes, length);
+  sb->length += length;
+  sb->string[sb->length] = '\0';
+  return true;
+}
+
+inline bool StringBuilderAddString(StringBuilder *sb, const char *s) {
+  return StringBuilderAddBytes(sb, s, StringLength(s));
+}
+
+inline bool StringBuilderAddView(StringBuilder *sb, StringView sv) {
+  return StringBuilderAddBytes(sb, sv.ptr, sv.len);
+}
+
+inline StringView StringBuilderView(const StringBuilder *sb) {
+  return (StringView){sb->string, sb->length};
+}
+
+// Size of a regular file opened as f, or 0 when it is not known up front.
+static size_t FileSize(FILE *f) {
+  struct stat st;
+  if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    return st.st_size;
+  }
+  return 0;
+}
+
+// Reads the rest of f straight into the builder. When size is right, this
+// is a single fread of size + 1 bytes, the short read signals the end.
+static bool StringBuilderReadStream(StringBuilder *sb, FILE *f, size_t size) {
+  setvbuf(f, NULL, _IONBF, 0);
+  size_t chunk = size + 1 > FREAD_BUFFER_SIZE ? size + 1 : FREAD_BUFFER_SIZE;
+  while (true) {
+    if (sb->length + 1 >= sb->capacity && !StringBuilderReserve(sb, chunk)) {
+      return false;
+    }
+    size_t available = sb->capacity - sb->length - 1;
+    size_t n = fread(sb->string + sb->length, sizeof(char), available, f);
+    sb->length += n;
+    sb->string[sb->length] = '\0';
+    if (n < available) {
+      return ferror(f) == 0;
+    }
+    chunk = sb->capacity;
+  }
+}
+
+// Room for size more bytes, the probe byte of the single read and the
+// terminator. A dynamic builder grows to exactly that, because doubling would
+// allocate up to twice a large file.
+static bool StringBuilderReserveFile(StringBuilder *sb, size_t size) {
+  size_t capacity = sb->length + size + 2;
+  if (capacity <= sb->capacity) {
+    return true;
+  }
+  if (!sb->is_dynamic) {
+    return false;
+  }
+  char *string = sb->arena != NULL
+    ? ArenaRealloc(sb->arena, sb->string, sb->capacity, capacity)
+    : realloc(sb->string, sizeof(char) * capacity);
+  if (string == NULL) {
+    return false;
+  }
+  if (sb->capacity == 0) {
+    string[0] = '\0';
+  }
+  sb->string = string;
+  sb->capacity = capacity;
+  return true;
+}
+
+inline bool StringBuilderReadFile(StringBuilder *sb, const char *file_path) {
+  if (sb == NULL) {
+    return false;
+  }
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  size_t size = FileSize(f);
+  if (size > 0 && !StringBuilderReserveFile(sb, size)) {
+    fclose(f);
+    return false;
+  }
+  bool ok = StringBuilderReadStream(sb, f, size);
+  return fclose(f) == 0 && ok;
+}
+
+inline bool StringBuilderClear(StringBuilder *sb) {
+  if (sb != NULL && sb->length > 0) {
+    sb->length = 0;
+    sb->string[0] = '\0';
+    return true;
+  }
+  return false;
+}
+
+inline bool StringBuilderPrintf(StringBuilder *sb, const char *format, ...) {
+  if (sb == NULL) {
+    return false;
+  }
+  va_list valist;
+  va_start(valist, format);
+  bool ok = StringBuilderFormat(sb, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+  return ok;
+}
+
+#pragma endregion
+#pragma region File System
+
+inline bool FileExists(const char *file_path) {
+  return access(file_path, F_OK) == 0;
+}
+
+inline bool PathIsFile(const char *path) {
+  struct stat s;
+  if (stat(path, &s) == 0) {
+    return S_ISREG(s.st_mode);
+  }
+  return false;
+}
+
+inline bool PathIsDir(const char *path) {
+  struct stat s;
+  if (stat(path, &s) == 0) {
+    return S_ISDIR(s.st_mode);
+  }
+  return false;
+}
+
+inline bool CreateNewFile(const char *file_path) {
+  FILE *f = fopen(file_path, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  return fclose(f) == 0;
+}
+
+inline bool RemoveFile(const char *file_path) {
+  return remove(file_path) == 0;
+}
+
+inline char* PathBaseName(const char *file_path) {
+  int64_t index = StringLastIndexOf(file_path, "/");
+  if (index == -1) {
+    return (char*)file_path;
+  } else {
+    return (char*)(file_path + index + 1);
+  }
+}
+
+inline bool PathBaseNameToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
+  char *base_name = PathBaseName(file_path);
+  if (StringLength(base_name) < buffer_size) {
+    strcpy(buffer, base_name);
+    return true;
+  }
+  return false;
+}
+
+inline bool PathDirNameToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
+  int64_t index = StringLastIndexOf(file_path, "/");
+  if (index == -1) {
+    size_t length = StringLength(file_path);
+    if (length < buffer_size) {
+      strcpy(buffer, file_path);
+      return true;
+    }
+    return false;
+  }
+  return StringSliceToBuffer(buffer, buffer_size, file_path, 0, index);
+}
+
+inline char* PathDirNameAlloc(const char *file_path) {
+  return StringViewAlloc(PathDirNameView(file_path));
+}
+
+inline char* PathExt(const char *file_path) {
+  int64_t index = StringLastIndexOf(file_path, "/");
+  if (index == -1) {
+    index = 0;
+  }
+  int64_t dot_index = StringLastIndexOf(file_path + index, ".");
+  if (dot_index == -1) {
+    return NULL;
+  }
+  return (char*)(file_path + index + dot_index);
+}
+
+inline bool PathExtToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
+  int64_t index = StringLastIndexOf(file_path, "/");
+  if (index == -1) {
+    index = 0;
+  }
+  int64_t dot_index = StringLastIndexOf(file_path + index, ".");
+  if (dot_index == -1) {
+    return false;
+  }
+  return StringSliceToBuffer(buffer, buffer_size, file_path, index + dot_index, StringLength(file_path));
+}
+
+inline char* PathExtAlloc(const char *file_path) {
+  StringView ext = PathExtView(file_path);
+  return ext.ptr == NULL ? NULL : StringViewAlloc(ext);
+}
+
+inline StringView PathBaseNameView(const char *file_path) {
+  StringView path = CreateStringView(file_path);
+  int64_t index = StringViewFindLastChar(path, '/');
+  return StringViewSlice(path, index + 1, path.len);
+}
+
+inline StringView PathDirNameView(const char *file_path) {
+  StringView path = CreateStringView(file_path);
+  int64_t index = StringViewFindLastChar(path, '/');
+  return index == -1 ? path : StringViewFirstN(path, index);
+}
+
+inline StringView PathExtView(const char *file_path) {
+  StringView path = CreateStringView(file_path);
+  int64_t index = StringViewFindLastChar(path, '/');
+  if (index == -1) {
+    index = 0;
+  }
+  int64_t dot_index = StringViewFindLastChar(StringViewSlice(path, index, path.len), '.');
+  if (dot_index == -1) {
+    return (StringView){NULL, 0};
+  }
+  return StringViewSlice(path, index + dot_index, path.len);
+}
+
+#pragma endregion
+#pragma region IO
+
+inline bool ReadFileToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  setvbuf(f, NULL, _IONBF, 0);
+  size_t n = buffer_size > 0 ? fread(buffer, sizeof(char), buffer_size - 1, f) : 0;
+  if (buffer_size > 0) {
+    buffer[n] = '\0';
+  }
+  return fclose(f) == 0;
+}
+
+inline char* ReadFileAlloc(const char *file_path) {
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  size_t size = FileSize(f);
+  StringBuilder sb = CreateDynamicStringBuilder(size + 2);
+  bool ok = sb.string != NULL && StringBuilderReadStream(&sb, f, size);
+  if (fclose(f) != 0 || !ok) {
+    DeallocateStringBuilder(&sb);
+    return NULL;
+  }
+  return sb.string;
+}
+
+inline bool AllocateMappedFile(MappedFile *mf, const char *file_path) {
+  mf->data = NULL;
+  mf->size = 0;
+  mf->is_mapped = false;
+#ifndef _WIN32
+  int fd = open(file_path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+#ifdef POSIX_MADV_SEQUENTIAL
+      posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+      close(fd);
+      mf->data = data;
+      mf->size = st.st_size;
+      mf->is_mapped = true;
+      return true;
+    }
+  }
+  close(fd);
+#endif
+  // Not mappable (or no mmap at all): one allocation and one read.
+  StringBuilder sb = {.is_dynamic = true};
+  if (!StringBuilderReadFile(&sb, file_path)) {
+    free(sb.string);
+    return false;
+  }
+  mf->data = sb.string;
+  mf->size = sb.length;
+  return true;
+}
+
+inline bool DeallocateMappedFile(MappedFile *mf) {
+  if (mf == NULL) {
+    return false;
+  }
+#ifndef _WIN32
+  if (mf->is_mapped) {
+    munmap((void*)mf->data, mf->size);
+  } else {
+    free((void*)mf->data);
+  }
+#else
+  free((void*)mf->data);
+#endif
+  mf->data = NULL;
+  mf->size = 0;
+  mf->is_mapped = false;
+  return true;
+}
+
+static bool LineReaderInit(LineReader *lr, int fd, bool owns_fd) {
+  *lr = (LineReader){.fd = fd, .owns_fd = owns_fd};
+  lr->buffer = malloc(LINE_READER_BLOCK_SIZE);
+  if (lr->buffer == NULL) {
+    return false;
+  }
+  lr->capacity = LINE_READER_BLOCK_SIZE;
+  return true;
+}
+
+inline bool AllocateLineReader(LineReader *lr, const char *file_path) {
+#ifdef O_BINARY
+  int fd = open(file_path, O_RDONLY | O_BINARY);
+#else
+  int fd = open(file_path, O_RDONLY);
+#endif
+  if (fd == -1) {
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  if (!LineReaderInit(lr, fd, true)) {
+    close(fd);
+    return false;
+  }
+  return true;
+}
+
+inline bool AllocateLineReaderFd(LineReader *lr, int fd) {
+  return LineReaderInit(lr, fd, false);
+}
+
+inline bool DeallocateLineReader(LineReader *lr) {
+  if (lr == NULL) {
+    return false;
+  }
+  bool ok = !lr->owns_fd || close(lr->fd) == 0;
+  free(lr->buffer);
+  *lr = (LineReader){.fd = -1};
+  return ok;
+}
+
+// Moves the partial line to the front and reads the next block behind it.
+// The buffer only grows when a single line fills all of it.
+static bool LineReaderFill(LineReader *lr) {
+  if (lr->start > 0) {
+    memmove(lr->buffer, lr->buffer + lr->start, lr->end - lr->start);
+    lr->end -= lr->start;
+    lr->scanned -= lr->start;
+    lr->start = 0;
+  }
+  if (lr->end == lr->capacity) {
+    char *buffer = realloc(lr->buffer, lr->capacity * 2);
+    if (buffer == NULL) {
+      lr->failed = true;
+      return false;
+    }
+    lr->buffer = buffer;
+    lr->capacity *= 2;
+  }
+  int64_t n;
+  do {
+    n = read(lr->fd, lr->buffer + lr->end, lr->capacity - lr->end);
+  } while (n == -1 && errno == EINTR);
+  if (n <= 0) {
+    lr->eof = true;
+    lr->failed = n < 0;
+    return false;
+  }
+  lr->end += n;
+  return true;
+}
+
+inline bool LineReaderNext(LineReader *lr, StringView *line) {
+  while (true) {
+    const char *newline = MemoryFindCharKernel(lr->buffer + lr->scanned, lr->end - lr->scanned, '\n');
+    if (newline != NULL) {
+      size_t end = newline - lr->buffer;
+      *line = (StringView){lr->buffer + lr->start, end - lr->start};
+      lr->start = lr->scanned = end + 1;
+      break;
+    }
+    lr->scanned = lr->end;
+    if (lr->eof || !LineReaderFill(lr)) {
+      if (lr->start == lr->end || lr->failed) {
+        return false;
+      }
+      *line = (StringView){lr->buffer + lr->start, lr->end - lr->start};
+      lr->start = lr->end;
+      break;
+    }
+  }
+  if (line->len > 0 && line->ptr[line->len - 1] == '\r') {
+    line->len--;
+  }
+  lr->line_number++;
+  return true;
+}
+
+inline bool ReadUserInputToBuffer(char *buffer, size_t buffer_size) {
+  return fgets(buffer, buffer_size - 1, stdin) != NULL;
+}
+
+// Reads with fgets straight into the builder, so stdin stays usable by
+// other stdio calls. The line break (\n or \r\n) is not kept. Only a
+// dynamic builder grows, a static one reads into the room it has left and
+// returns false when the line does not fit.
+inline bool ReadUserInputToStringBuilder(StringBuilder *sb) {
+  if (sb == NULL) {
+    return false;
+  }
+  size_t start = sb->length;
+  while (!sb->is_dynamic || StringBuilderReserve(sb, FREAD_BUFFER_SIZE)) {
+    size_t room = sb->capacity - sb->length;
+    if (room < 2) {
+      break;
+    }
+    char *chunk = sb->string + sb->length;
+    if (fgets(chunk, room < FREAD_BUFFER_SIZE ? (int)room : FREAD_BUFFER_SIZE, stdin) == NULL) {
+      sb->string[sb->length] = '\0';
+      return ferror(stdin) == 0;
+    }
+    sb->length += StringLength(chunk);
+    if (sb->length > start && sb->string[sb->length - 1] == '\n') {
+      sb->length--;
+      if (sb->length > start && sb->string[sb->length - 1] == '\r') {
+        sb->length--;
+      }
+      sb->string[sb->length] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+inline char* ReadUserInputAlloc(void) {
+  StringBuilder sb = CreateDynamicStringBuilder(0);
+  if (ReadUserInputToStringBuilder(&sb)) {
+    return sb.string;
+  }
+  return NULL;
+}
+
+inline bool WriteToFile(const char *file_path, const char *s) {
+  FILE *f = fopen(file_path, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  size_t length = StringLength(s);
+  uint64_t n = fwrite(s, sizeof(char), length, f);
+  return n == length && fclose(f) == 0;
+}
+
+inline bool AppendToFile(const char *file_path, const char *s) {
+  FILE *f = fopen(file_path, "ab");
+  if (f == NULL) {
+    return false;
+  }
+  size_t length = StringLength(s);
+  uint64_t n = fwrite(s, sizeof(char), length, f);
+  return n == length && fclose(f) == 0;
+}
+
+// Output to stdout and stderr goes out as one fwrite per record, so the
+// stdio lock is taken once per record instead of once per character. With
+// OutputSetBuffered, records are collected in a per-thread buffer and written
+// together when it fills up or on OutputFlush. The buffers are allocated when
+// buffering is turned on, so threads that never use it only pay for a
+// pointer of thread local storage.
+
+typedef struct OutputBuffer {
+  size_t length;
+  char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+// stdout and stderr, NULL while the thread is not buffering.
+static THREAD_LOCAL OutputBuffer *output_buffers = NULL;
+
+static void OutputBufferFlush(OutputBuffer *ob, FILE *file) {
+  if (ob->length > 0) {
+    fwrite(ob->data, sizeof(char), ob->length, file);
+    ob->length = 0;
+  }
+}
+
+static void OutputWrite(FILE *file, const char *data, size_t length) {
+  if (output_buffers == NULL || (file != stdout && file != stderr)) {
+    fwrite(data, sizeof(char), length, file);
+    return;
+  }
+  OutputBuffer *ob = &output_buffers[file == stderr];
+  if (ob->length + length > OUTPUT_BUFFER_SIZE) {
+    OutputBufferFlush(ob, file);
+  }
+  if (length > OUTPUT_BUFFER_SIZE) {
+    fwrite(data, sizeof(char), length, file);
+    return;
+  }
+  memcpy(ob->data + ob->length, data, length);
+  ob->length += length;
+}
+
+static bool OutputFormat(FILE *file, const FormatJob *job) {
+  char buffer[OUTPUT_BUFFER_SIZE];
+  StringBuilder stack = CreateStaticStringBuilder(buffer, sizeof(buffer));
+  StringBuilder heap = {0};
+  StringBuilder *record = FormatRecord(&stack, &heap, job);
+  if (record != NULL) {
+    OutputWrite(file, record->string, record->length);
+  }
+  free(heap.string);
+  return record != NULL;
+}
+
+// Without memory for the buffers, output simply stays unbuffered.
+inline void OutputSetBuffered(bool buffered) {
+  if (buffered && output_buffers == NULL) {
+    output_buffers = malloc(2 * sizeof(OutputBuffer));
+    if (output_buffers != NULL) {
+      output_buffers[0].length = 0;
+      output_buffers[1].length = 0;
+    }
+  }
+  else if (!buffered && output_buffers != NULL) {
+    OutputBufferFlush(&output_buffers[0], stdout);
+    OutputBufferFlush(&output_buffers[1], stderr);
+    free(output_buffers);
+    output_buffers = NULL;
+  }
+}
+
+inline void OutputFlush(void) {
+  if (output_buffers != NULL) {
+    OutputBufferFlush(&output_buffers[0], stdout);
+    OutputBufferFlush(&output_buffers[1], stderr);
+  }
+  fflush(stdout);
+  fflush(stderr);
+}
+
+void WriteStringToFile(FILE *file, const char *s) {
+  OutputWrite(file, s, StringLength(s));
+}
+
+inline void WriteStringToStdOut(const char *s) {
+  OutputWrite(stdout, s, StringLength(s));
+}
+
+inline void WriteStringToStdErr(const char *s) {
+  OutputWrite(stderr, s, StringLength(s));
+}
+
+void WriteInt64ToFile(FILE *file, int64_t value) {
+  char buffer[24];
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  OutputWrite(file, buffer, IntegerToStringToBuffer(buffer, ArraySize(buffer), magnitude, value < 0, 10));
+}
+
+void WriteUint64ToFile(FILE *file, uint64_t value) {
+  char buffer[24];
+  OutputWrite(file, buffer, IntegerToStringToBuffer(buffer, ArraySize(buffer), value, false, 10));
+}
+
+inline void WriteInt64ToStdOut(int64_t value) {
+  WriteInt64ToFile(stdout, value);
+}
+
+inline void WriteInt64ToStdErr(int64_t value) {
+  WriteInt64ToFile(stderr, value);
+}
+
+inline void WriteUint64ToStdOut(uint64_t value) {
+  WriteUint64ToFile(stdout, value);
+}
+
+inline void WriteUint64ToStdErr(uint64_t value) {
+  WriteUint64ToFile(stderr, value);
+}
+
+void Printf(const char *format, ...) {
+  va_list valist;
+  va_start(valist, format);
+  OutputFormat(stdout, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+}
+
+void Errorf(const char *format, ...) {
+  va_list valist;
+  va_start(valist, format);
+  OutputFormat(stderr, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+}
+
+void PrintfCompiled(const CompiledFormat *cf, ...) {
+  va_list valist;
+  va_start(valist, cf);
+  OutputFormat(stdout, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+}
+
+void ErrorfCompiled(const CompiledFormat *cf, ...) {
+  va_list valist;
+  va_start(valist, cf);
+  OutputFormat(stderr, &(FormatJob){.cf = cf, .valist = &valist});
+  va_end(valist);
+}
+
+bool PrintfArgs(const char *format, const FormatArg *args, size_t number_of_args) {
+  FormatJob job = {.format = format, .args = args, .number_of_args = number_of_args};
+  return OutputFormat(stdout, &job);
+}
+
+bool ErrorfArgs(const char *format, const FormatArg *args, size_t number_of_args) {
+  FormatJob job = {.format = format, .args = args, .number_of_args = number_of_args};
+  return OutputFormat(stderr, &job);
+}
+
+bool WriteFormatToFile(const char *file_path, const char *format, ...) {
+  FILE *f = fopen(file_path, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  va_list valist;
+  va_start(valist, format);
+  OutputFormat(f, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+  return fclose(f) == 0;
+}
+
+bool AppendFormatToFile(const char *file_path, const char *format, ...) {
+  FILE *f = fopen(file_path, "ab");
+  if (f == NULL) {
+    return false;
+  }
+  va_list valist;
+  va_start(valist, format);
+  OutputFormat(f, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+  return fclose(f) == 0;
+}
+
+inline void WriteCharToStdOut(char c) {
+  OutputWrite(stdout, &c, 1);
+}
+
+inline void WriteCharToStdErr(char c) {
+  OutputWrite(stderr, &c, 1);
+}
+
+// Records are formatted on the calling thread and copied into a bounded ring
+// of fixed size slots (Vyukov's bounded queue, with a single consumer). Each
+// slot carries a sequence number that tells producers and the writer thread
+// whose turn it is. The writer copies ready records into a batch and writes
+// it with one fwrite. It sleeps when the ring is empty, producers only take
+// the mutex to wake it up. With ASYNC_LOG_BLOCK, producers that find the ring
+// full sleep on the space condition until the writer has taken records out.
+
+#ifndef _WIN32
+
+typedef struct AsyncLogSlot {
+  atomic_size_t sequence;
+  size_t length;
+  char data[ASYNC_LOG_RECORD_SIZE];
+} AsyncLogSlot;
+
+struct AsyncLog {
+  FILE *file;
+  bool owns_file;
+  AsyncLogPolicy policy;
+  size_t mask;
+  AsyncLogSlot *slots;
+  char *batch;
+  atomic_size_t head;
+  atomic_uint_fast64_t dropped;
+  atomic_bool sleeping;
+  atomic_bool stopping;
+  atomic_size_t blocked;
+  size_t written;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t space;
+  pthread_cond_t done;
+  struct AsyncLog *next;
+};
+
+static pthread_mutex_t async_logs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t async_logs_once = PTHREAD_ONCE_INIT;
+static AsyncLog *async_logs = NULL;
+
+static void AsyncLogWake(AsyncLog *log) {
+  pthread_mutex_lock(&log->mutex);
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->mutex);
+}
+
+static bool AsyncLogReady(AsyncLog *log, size_t position) {
+  AsyncLogSlot *slot = &log->slots[position & log->mask];
+  return atomic_load_explicit(&slot->sequence, memory_order_acquire) == position + 1;
+}
+
+static void* AsyncLogRun(void *arg) {
+  AsyncLog *log = arg;
+  char *batch = log->batch;
+  size_t tail = 0;
+  while (true) {
+    size_t length = 0;
+    while (length + ASYNC_LOG_RECORD_SIZE <= ASYNC_LOG_BATCH_SIZE && AsyncLogReady(log, tail)) {
+      AsyncLogSlot *slot = &log->slots[tail & log->mask];
+      memcpy(batch + length, slot->data, slot->length);
+      length += slot->length;
+      atomic_store_explicit(&slot->sequence, tail + log->mask + 1, memory_order_release);
+      tail++;
+    }
+    // Pairs with a blocked producer counting itself before it checks the ring.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (length > 0 && atomic_load_explicit(&log->blocked, memory_order_relaxed) > 0) {
+      pthread_mutex_lock(&log->mutex);
+      pthread_cond_broadcast(&log->space);
+      pthread_mutex_unlock(&log->mutex);
+    }
+    if (length > 0) {
+      fwrite(batch, sizeof(char), length, log->file);
+      if (!AsyncLogReady(log, tail)) {
+        fflush(log->file);
       }
+      pthread_mutex_lock(&log->mutex);
+      log->written = tail;
+      pthread_cond_broadcast(&log->done);
+      pthread_mutex_unlock(&log->mutex);
+      continue;
     }
-    s++;
+    if (atomic_load(&log->stopping)) {
+      break;
+    }
+    pthread_mutex_lock(&log->mutex);
+    atomic_store(&log->sleeping, true);
+    if (!AsyncLogReady(log, tail) && !atomic_load(&log->stopping)) {
+      struct timespec deadline;
+      timespec_get(&deadline, TIME_UTC);
+      deadline.tv_nsec += 100 * 1000 * 1000;
+      if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+      }
+      pthread_cond_timedwait(&log->wake, &log->mutex, &deadline);
+    }
+    atomic_store(&log->sleeping, false);
+    pthread_mutex_unlock(&log->mutex);
   }
-  return false;
+  return NULL;
 }
 
-inline bool StringIn(const char *s, const char *haystack, const char *separator) {
-  size_t i = 0, j = 0;
-  size_t separator_length = StringLength(separator);
-  do {
-    if (StringStartsWith(haystack + j, separator) || haystack[j] == '\0') {
-      for (size_t k = i, h = 0; k < j && s[h] != '\0'; k++, h++) {
-        if (haystack[k] != s[h]) {
-          goto ContinueDoWhile;
-        }
+static void AsyncLogFlushAll(void) {
+  pthread_mutex_lock(&async_logs_mutex);
+  for (AsyncLog *log = async_logs; log != NULL; log = log->next) {
+    AsyncLogFlush(log);
+  }
+  pthread_mutex_unlock(&async_logs_mutex);
+}
+
+static void AsyncLogRegisterAtExit(void) {
+  atexit(AsyncLogFlushAll);
+}
+
+// Opens file_path for appending, stderr when file_path is NULL.
+static FILE* AsyncLogOpen(const char *file_path) {
+  return file_path == NULL ? stderr : fopen(file_path, "ab");
+}
+
+static void AsyncLogClose(AsyncLog *log) {
+  if (log->owns_file) {
+    fclose(log->file);
+  } else {
+    fflush(log->file);
+  }
+}
+
+AsyncLog* NewAsyncLog(const char *file_path, size_t capacity, AsyncLogPolicy policy) {
+  size_t slots = 2;
+  while (slots < capacity) {
+    slots <<= 1;
+  }
+  AsyncLog *log = calloc(1, sizeof(AsyncLog));
+  if (log == NULL) {
+    return NULL;
+  }
+  // The writer's batch buffer shares the allocation of the ring.
+  log->slots = malloc(slots * sizeof(AsyncLogSlot) + ASYNC_LOG_BATCH_SIZE);
+  if (log->slots == NULL) {
+    free(log);
+    return NULL;
+  }
+  log->batch = (char*)(log->slots + slots);
+  log->file = AsyncLogOpen(file_path);
+  if (log->file == NULL) {
+    free(log->slots);
+    free(log);
+    return NULL;
+  }
+  for (size_t i = 0; i < slots; i++) {
+    atomic_init(&log->slots[i].sequence, i);
+  }
+  log->owns_file = file_path != NULL;
+  log->policy = policy;
+  log->mask = slots - 1;
+  pthread_mutex_init(&log->mutex, NULL);
+  pthread_cond_init(&log->wake, NULL);
+  pthread_cond_init(&log->space, NULL);
+  pthread_cond_init(&log->done, NULL);
+  if (pthread_create(&log->thread, NULL, AsyncLogRun, log) != 0) {
+    pthread_cond_destroy(&log->done);
+    pthread_cond_destroy(&log->space);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->mutex);
+    AsyncLogClose(log);
+    free(log->slots);
+    free(log);
+    return NULL;
+  }
+  pthread_once(&async_logs_once, AsyncLogRegisterAtExit);
+  pthread_mutex_lock(&async_logs_mutex);
+  log->next = async_logs;
+  async_logs = log;
+  pthread_mutex_unlock(&async_logs_mutex);
+  return log;
+}
+
+void FreeAsyncLog(AsyncLog *log) {
+  if (log == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&async_logs_mutex);
+  for (AsyncLog **it = &async_logs; *it != NULL; it = &(*it)->next) {
+    if (*it == log) {
+      *it = log->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&async_logs_mutex);
+  atomic_store(&log->stopping, true);
+  AsyncLogWake(log);
+  pthread_join(log->thread, NULL);
+  AsyncLogClose(log);
+  pthread_cond_destroy(&log->done);
+  pthread_cond_destroy(&log->space);
+  pthread_cond_destroy(&log->wake);
+  pthread_mutex_destroy(&log->mutex);
+  free(log->slots);
+  free(log);
+}
+
+// Sleeps until the writer frees a slot. The producer counts itself and checks
+// the ring again under the mutex, so the writer either sees the count and
+// signals, or the check sees the free slot.
+static void AsyncLogWaitForSpace(AsyncLog *log) {
+  pthread_mutex_lock(&log->mutex);
+  atomic_fetch_add(&log->blocked, 1);
+  pthread_cond_signal(&log->wake);
+  size_t position = atomic_load(&log->head);
+  AsyncLogSlot *slot = &log->slots[position & log->mask];
+  if ((intptr_t)(atomic_load(&slot->sequence) - position) < 0) {
+    pthread_cond_wait(&log->space, &log->mutex);
+  }
+  atomic_fetch_sub(&log->blocked, 1);
+  pthread_mutex_unlock(&log->mutex);
+}
+
+static bool AsyncLogPush(AsyncLog *log, const char *data, size_t length) {
+  size_t position = atomic_load_explicit(&log->head, memory_order_relaxed);
+  AsyncLogSlot *slot;
+  while (true) {
+    slot = &log->slots[position & log->mask];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(&log->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
       }
-      return true;
-ContinueDoWhile:
-      i = j + separator_length;
+    } else if (difference < 0) {
+      if (log->policy == ASYNC_LOG_DROP) {
+        atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+        return false;
+      }
+      AsyncLogWaitForSpace(log);
+      position = atomic_load_explicit(&log->head, memory_order_relaxed);
+    } else {
+      position = atomic_load_explicit(&log->head, memory_order_relaxed);
     }
-  } while (haystack[j++] != '\0');
-  return false;
+  }
+  memcpy(slot->data, data, length);
+  slot->length = length;
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+  // Pairs with the writer setting sleeping before it checks the ring again.
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&log->sleeping, memory_order_relaxed)) {
+    AsyncLogWake(log);
+  }
+  return true;
 }
 
-inline bool StringEquals(const char *s1, const char *s2) {
-  do {
-    if (*s1 != *s2) {
+void AsyncLogFlush(AsyncLog *log) {
+  size_t target = atomic_load(&log->head);
+  pthread_mutex_lock(&log->mutex);
+  while (log->written - target > SIZE_MAX / 2) {
+    pthread_cond_signal(&log->wake);
+    pthread_cond_wait(&log->done, &log->mutex);
+  }
+  pthread_mutex_unlock(&log->mutex);
+}
+
+inline uint64_t AsyncLogDropped(AsyncLog *log) {
+  return atomic_load_explicit(&log->dropped, memory_order_relaxed);
+}
+
+#else
+
+// The same ring under a critical section, since the lock free version needs
+// C11 atomics. Producers hold the lock only to copy their record in, the
+// writer releases it around fwrite.
+
+typedef struct AsyncLogSlot {
+  size_t length;
+  char data[ASYNC_LOG_RECORD_SIZE];
+} AsyncLogSlot;
+
+struct AsyncLog {
+  FILE *file;
+  bool owns_file;
+  AsyncLogPolicy policy;
+  size_t mask;
+  AsyncLogSlot *slots;
+  char *batch;
+  size_t head;
+  size_t tail;
+  uint64_t dropped;
+  bool stopping;
+  size_t written;
+  HANDLE thread;
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE wake;
+  CONDITION_VARIABLE space;
+  CONDITION_VARIABLE done;
+  struct AsyncLog *next;
+};
+
+static SRWLOCK async_logs_lock = SRWLOCK_INIT;
+static INIT_ONCE async_logs_once = INIT_ONCE_STATIC_INIT;
+static AsyncLog *async_logs = NULL;
+
+static DWORD WINAPI AsyncLogRun(void *arg) {
+  AsyncLog *log = arg;
+  EnterCriticalSection(&log->lock);
+  while (true) {
+    while (log->head == log->tail && !log->stopping) {
+      SleepConditionVariableCS(&log->wake, &log->lock, INFINITE);
+    }
+    if (log->head == log->tail) {
+      break;
+    }
+    size_t length = 0;
+    while (length + ASYNC_LOG_RECORD_SIZE <= ASYNC_LOG_BATCH_SIZE && log->tail != log->head) {
+      AsyncLogSlot *slot = &log->slots[log->tail & log->mask];
+      memcpy(log->batch + length, slot->data, slot->length);
+      length += slot->length;
+      log->tail++;
+    }
+    size_t tail = log->tail;
+    bool idle = log->head == tail;
+    WakeAllConditionVariable(&log->space);
+    LeaveCriticalSection(&log->lock);
+    fwrite(log->batch, sizeof(char), length, log->file);
+    if (idle) {
+      fflush(log->file);
+    }
+    EnterCriticalSection(&log->lock);
+    log->written = tail;
+    WakeAllConditionVariable(&log->done);
+  }
+  LeaveCriticalSection(&log->lock);
+  return 0;
+}
+
+static void AsyncLogFlushAll(void) {
+  AcquireSRWLockShared(&async_logs_lock);
+  for (AsyncLog *log = async_logs; log != NULL; log = log->next) {
+    AsyncLogFlush(log);
+  }
+  ReleaseSRWLockShared(&async_logs_lock);
+}
+
+static BOOL CALLBACK AsyncLogRegisterAtExit(INIT_ONCE *once, void *parameter, void **context) {
+  (void)once;
+  (void)parameter;
+  (void)context;
+  atexit(AsyncLogFlushAll);
+  return TRUE;
+}
+
+// Opens file_path for appending, stderr when file_path is NULL.
+static FILE* AsyncLogOpen(const char *file_path) {
+  return file_path == NULL ? stderr : fopen(file_path, "ab");
+}
+
+static void AsyncLogClose(AsyncLog *log) {
+  if (log->owns_file) {
+    fclose(log->file);
+  } else {
+    fflush(log->file);
+  }
+}
+
+AsyncLog* NewAsyncLog(const char *file_path, size_t capacity, AsyncLogPolicy policy) {
+  size_t slots = 2;
+  while (slots < capacity) {
+    slots <<= 1;
+  }
+  AsyncLog *log = calloc(1, sizeof(AsyncLog));
+  if (log == NULL) {
+    return NULL;
+  }
+  // The writer's batch buffer shares the allocation of the ring.
+  log->slots = malloc(slots * sizeof(AsyncLogSlot) + ASYNC_LOG_BATCH_SIZE);
+  if (log->slots == NULL) {
+    free(log);
+    return NULL;
+  }
+  log->batch = (char*)(log->slots + slots);
+  log->file = AsyncLogOpen(file_path);
+  if (log->file == NULL) {
+    free(log->slots);
+    free(log);
+    return NULL;
+  }
+  log->owns_file = file_path != NULL;
+  log->policy = policy;
+  log->mask = slots - 1;
+  InitializeCriticalSection(&log->lock);
+  InitializeConditionVariable(&log->wake);
+  InitializeConditionVariable(&log->space);
+  InitializeConditionVariable(&log->done);
+  log->thread = CreateThread(NULL, 0, AsyncLogRun, log, 0, NULL);
+  if (log->thread == NULL) {
+    DeleteCriticalSection(&log->lock);
+    AsyncLogClose(log);
+    free(log->slots);
+    free(log);
+    return NULL;
+  }
+  InitOnceExecuteOnce(&async_logs_once, AsyncLogRegisterAtExit, NULL, NULL);
+  AcquireSRWLockExclusive(&async_logs_lock);
+  log->next = async_logs;
+  async_logs = log;
+  ReleaseSRWLockExclusive(&async_logs_lock);
+  return log;
+}
+
+void FreeAsyncLog(AsyncLog *log) {
+  if (log == NULL) {
+    return;
+  }
+  AcquireSRWLockExclusive(&async_logs_lock);
+  for (AsyncLog **it = &async_logs; *it != NULL; it = &(*it)->next) {
+    if (*it == log) {
+      *it = log->next;
+      break;
+    }
+  }
+  ReleaseSRWLockExclusive(&async_logs_lock);
+  EnterCriticalSection(&log->lock);
+  log->stopping = true;
+  WakeConditionVariable(&log->wake);
+  LeaveCriticalSection(&log->lock);
+  WaitForSingleObject(log->thread, INFINITE);
+  CloseHandle(log->thread);
+  AsyncLogClose(log);
+  DeleteCriticalSection(&log->lock);
+  free(log->slots);
+  free(log);
+}
+
+static bool AsyncLogPush(AsyncLog *log, const char *data, size_t length) {
+  EnterCriticalSection(&log->lock);
+  while (log->head - log->tail > log->mask) {
+    if (log->policy == ASYNC_LOG_DROP) {
+      log->dropped++;
+      LeaveCriticalSection(&log->lock);
       return false;
     }
-  } while (*s1++ != '\0' && *s2++ != '\0');
+    SleepConditionVariableCS(&log->space, &log->lock, INFINITE);
+  }
+  AsyncLogSlot *slot = &log->slots[log->head & log->mask];
+  memcpy(slot->data, data, length);
+  slot->length = length;
+  log->head++;
+  WakeConditionVariable(&log->wake);
+  LeaveCriticalSection(&log->lock);
   return true;
 }
 
-inline bool StringStartsWith(const char *s1, const char *s2) {
-  size_t s2_length = StringLength(s2);
-  if (StringLength(s1) < s2_length) {
+void AsyncLogFlush(AsyncLog *log) {
+  EnterCriticalSection(&log->lock);
+  size_t target = log->head;
+  while (log->written - target > SIZE_MAX / 2) {
+    WakeConditionVariable(&log->wake);
+    SleepConditionVariableCS(&log->done, &log->lock, INFINITE);
+  }
+  LeaveCriticalSection(&log->lock);
+}
+
+inline uint64_t AsyncLogDropped(AsyncLog *log) {
+  EnterCriticalSection(&log->lock);
+  uint64_t dropped = log->dropped;
+  LeaveCriticalSection(&log->lock);
+  return dropped;
+}
+
+#endif
+
+bool AsyncLogf(AsyncLog *log, const char *format, ...) {
+  char buffer[ASYNC_LOG_RECORD_SIZE];
+  StringBuilder stack = CreateStaticStringBuilder(buffer, sizeof(buffer));
+  StringBuilder heap = {0};
+  va_list valist;
+  va_start(valist, format);
+  StringBuilder *record = FormatRecord(&stack, &heap, &(FormatJob){.format = format, .valist = &valist});
+  va_end(valist);
+  if (record == &heap) {
+    // Too long for a record, keep the start and the trailing newline.
+    stack.length = sizeof(buffer);
+    memcpy(buffer, heap.string, sizeof(buffer));
+    if (heap.string[heap.length - 1] == '\n') {
+      buffer[sizeof(buffer) - 1] = '\n';
+    }
+  }
+  free(heap.string);
+  return record != NULL && AsyncLogPush(log, buffer, stack.length);
+}
+
+#pragma endregion
+#pragma region Util
+
+inline bool CreateAllocation(Allocation *a, size_t size) {
+  a->size = size;
+  a->memory = malloc(size);
+  if (a->memory == NULL) {
+    return false;
+  }
+  memset(a->memory, 0, size);
+  return true;
+}
+
+inline bool ResizeAllocation(Allocation *a, size_t size) {
+  if (size == a->size) {
+    return true;
+  }
+  a->memory = realloc(a->memory, size);
+  if (a->memory == NULL) {
+    return false;
+  }
+  memset(a->memory + a->size, 0, size - a->size);
+  a->size = size;
+  return true;
+}
+
+inline void FreeAllocation(Allocation *a) {
+  a->size = 0;
+  free(a->memory);
+}
+
+static size_t ArenaAlign(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static ArenaBlock* NewArenaBlock(ArenaBlock *previous, size_t size) {
+  size_t header_size = ArenaAlign(sizeof(ArenaBlock));
+  ArenaBlock *block = malloc(header_size + size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->previous = previous;
+  block->allocation.memory = (char*)block + header_size;
+  block->allocation.size = size;
+  block->used = 0;
+  return block;
+}
+
+inline Arena CreateArena(size_t block_size) {
+  return (Arena) {
+    .block = NULL,
+    .block_size = block_size > 0 ? ArenaAlign(block_size) : ARENA_DEFAULT_BLOCK_SIZE,
+  };
+}
+
+inline void* ArenaAlloc(Arena *arena, size_t size) {
+  size = ArenaAlign(size > 0 ? size : 1);
+  ArenaBlock *block = arena->block;
+  if (block == NULL || block->allocation.size - block->used < size) {
+    block = NewArenaBlock(block, size > arena->block_size ? size : arena->block_size);
+    if (block == NULL) {
+      return NULL;
+    }
+    arena->block = block;
+  }
+  void *memory = (char*)block->allocation.memory + block->used;
+  block->used += size;
+  return memory;
+}
+
+inline void* ArenaRealloc(Arena *arena, void *memory, size_t old_size, size_t new_size) {
+  if (memory == NULL) {
+    return ArenaAlloc(arena, new_size);
+  }
+  ArenaBlock *block = arena->block;
+  char *top = (char*)block->allocation.memory + block->used;
+  if ((char*)memory + ArenaAlign(old_size) == top) {
+    size_t offset = (char*)memory - (char*)block->allocation.memory;
+    if (ArenaAlign(new_size) <= block->allocation.size - offset) {
+      block->used = offset + ArenaAlign(new_size);
+      return memory;
+    }
+  }
+  if (new_size <= old_size) {
+    return memory;
+  }
+  void *result = ArenaAlloc(arena, new_size);
+  if (result != NULL) {
+    memcpy(result, memory, old_size);
+  }
+  return result;
+}
+
+inline ArenaMark CreateArenaMark(Arena *arena) {
+  return (ArenaMark) {
+    .block = arena->block,
+    .used = arena->block == NULL ? 0 : arena->block->used,
+  };
+}
+
+inline void ArenaRewind(Arena *arena, ArenaMark mark) {
+  while (arena->block != mark.block) {
+    ArenaBlock *previous = arena->block->previous;
+    free(arena->block);
+    arena->block = previous;
+  }
+  if (arena->block != NULL) {
+    arena->block->used = mark.used;
+  }
+}
+
+inline void ArenaReset(Arena *arena) {
+  if (arena->block == NULL) {
+    return;
+  }
+  while (arena->block->previous != NULL) {
+    ArenaBlock *previous = arena->block->previous;
+    free(arena->block);
+    arena->block = previous;
+  }
+  arena->block->used = 0;
+}
+
+inline void FreeArena(Arena *arena) {
+  ArenaRewind(arena, (ArenaMark) {0});
+}
+
+inline Arena* UseArena(Arena *arena) {
+  Arena *previous = current_arena;
+  current_arena = arena;
+  return previous;
+}
+
+inline bool CreateMemoryAllocation(MemoryAllocation *ma, size_t size_of_item, uint64_t number_of_items) {
+  ma->number_of_items = number_of_items;
+  ma->size_of_item = size_of_item;
+  ma->memory = calloc(number_of_items, size_of_item);
+  return ma->memory != NULL;
+}
+
+inline bool ResizeMemoryAllocation(MemoryAllocation *ma, uint64_t number_of_items) {
+  if (number_of_items == ma->number_of_items) {
+    return true;
+  }
+  size_t old_size = ma->size_of_item * ma->number_of_items;
+  uint64_t new_size = ma->size_of_item * number_of_items;
+  ma->memory = realloc(ma->memory, new_size);
+  if (ma->memory == NULL) {
     return false;
   }
-  for (size_t i = 0; i < s2_length; i++) {
-    if (s1[i] != s2[i]) {
-      return false;
+  if (new_size > old_size) {
+    memset(ma->memory + old_size, 0, new_size - old_size);
+  }
+  ma->number_of_items = number_of_items;
+  return true;
+}
+
+inline void FreeMemoryAllocation(MemoryAllocation *ma) {
+  ma->number_of_items = 0;
+  free(ma->memory);
+}
+
+// Items are carved out of slabs of items_per_slab items. Free items form an
+// intrusive list through their first word, slabs are chained the same way.
+
+inline bool CreateMemoryPool(MemoryPool *mp, size_t size_of_item, uint64_t items_per_slab) {
+  size_t size = size_of_item > sizeof(void*) ? size_of_item : sizeof(void*);
+  mp->size_of_item = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  mp->items_per_slab = items_per_slab > 0 ? items_per_slab : MEMORY_POOL_DEFAULT_ITEMS_PER_SLAB;
+  mp->free_list = NULL;
+  mp->slabs = NULL;
+  return true;
+}
+
+inline void* MemoryPoolAlloc(MemoryPool *mp) {
+  if (mp->free_list == NULL) {
+    size_t header_size = ARENA_ALIGNMENT;
+    char *slab = malloc(header_size + mp->size_of_item * mp->items_per_slab);
+    if (slab == NULL) {
+      return NULL;
+    }
+    *(void**)slab = mp->slabs;
+    mp->slabs = slab;
+    for (uint64_t i = mp->items_per_slab; i-- > 0;) {
+      void *item = slab + header_size + i * mp->size_of_item;
+      *(void**)item = mp->free_list;
+      mp->free_list = item;
+    }
+  }
+  void *item = mp->free_list;
+  mp->free_list = *(void**)item;
+  return item;
+}
+
+inline void MemoryPoolFree(MemoryPool *mp, void *item) {
+  if (item != NULL) {
+    *(void**)item = mp->free_list;
+    mp->free_list = item;
+  }
+}
+
+inline void FreeMemoryPool(MemoryPool *mp) {
+  while (mp->slabs != NULL) {
+    void *next = *(void**)mp->slabs;
+    free(mp->slabs);
+    mp->slabs = next;
+  }
+  mp->free_list = NULL;
+}
+
+static uint64_t HashRead64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t HashRead32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void HashMultiply(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, la = (uint32_t)*a, hb = *b >> 32, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t HashMix(uint64_t a, uint64_t b) {
+  HashMultiply(&a, &b);
+  return a ^ b;
+}
+
+// wyhash (final version 4): 48 bytes per step in three independent lanes.
+inline uint64_t HashBytes(const void *data, size_t length, uint64_t seed) {
+  static const uint64_t secret[4] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+  };
+  const unsigned char *p = data;
+  uint64_t a, b;
+  seed ^= HashMix(seed ^ secret[0], secret[1]);
+  if (length <= 16) {
+    if (length >= 4) {
+      size_t shift = (length >> 3) << 2;
+      a = (HashRead32(p) << 32) | HashRead32(p + shift);
+      b = (HashRead32(p + length - 4) << 32) | HashRead32(p + length - 4 - shift);
+    }
+    else if (length > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+      b = 0;
+    }
+    else {
+      a = b = 0;
+    }
+  }
+  else {
+    size_t i = length;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = HashMix(HashRead64(p) ^ secret[1], HashRead64(p + 8) ^ seed);
+        see1 = HashMix(HashRead64(p + 16) ^ secret[2], HashRead64(p + 24) ^ see1);
+        see2 = HashMix(HashRead64(p + 32) ^ secret[3], HashRead64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
     }
+    while (i > 16) {
+      seed = HashMix(HashRead64(p) ^ secret[1], HashRead64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = HashRead64(p + i - 16);
+    b = HashRead64(p + i - 8);
   }
-  return true;
+  a ^= secret[1];
+  b ^= seed;
+  HashMultiply(&a, &b);
+  return HashMix(a ^ secret[0] ^ length, b ^ secret[1]);
 }
 
-inline bool StringEndsWith(const char *s1, const char *s2) {
-  size_t s1_length = StringLength(s1);
-  size_t s2_length = StringLength(s2);
-  if (s1_length < s2_length) {
-    return false;
-  }
-  return StringEquals(s1 + (s1_length - s2_length), s2);
+inline uint64_t Hash(const char *s) {
+  return HashBytes(s, StringLength(s), 0);
 }
 
-inline int64_t StringFirstIndexOf(const char *s, const char *search) {
-  for (int64_t i = 0; s[i] != '\0'; i++) {
-    if (StringStartsWith(s + i, search)) {
-      return i;
-    }
-  }
-  return -1;
+// SipHash-1-3, one compression round per 8 byte word and three finalization
+// rounds, as used by the hash maps of several language runtimes.
+
+#define SIP_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(h)\
+  do {\
+    (h)->v0 += (h)->v1; (h)->v1 = SIP_ROTATE((h)->v1, 13); (h)->v1 ^= (h)->v0; (h)->v0 = SIP_ROTATE((h)->v0, 32);\
+    (h)->v2 += (h)->v3; (h)->v3 = SIP_ROTATE((h)->v3, 16); (h)->v3 ^= (h)->v2;\
+    (h)->v0 += (h)->v3; (h)->v3 = SIP_ROTATE((h)->v3, 21); (h)->v3 ^= (h)->v0;\
+    (h)->v2 += (h)->v1; (h)->v1 = SIP_ROTATE((h)->v1, 17); (h)->v1 ^= (h)->v2; (h)->v2 = SIP_ROTATE((h)->v2, 32);\
+  } while (0)
+
+static void HasherCompress(Hasher *h, uint64_t m) {
+  h->v3 ^= m;
+  SIP_ROUND(h);
+  h->v0 ^= m;
 }
 
-inline int64_t StringLastIndexOf(const char *s, const char *search) {
-  for (int64_t i = StringLength(s) - 1; i >= 0; i--) {
-    if (StringStartsWith(s + i, search)) {
-      return i;
+inline Hasher CreateHasher(uint64_t k0, uint64_t k1) {
+  return (Hasher) {
+    .v0 = k0 ^ 0x736f6d6570736575ULL,
+    .v1 = k1 ^ 0x646f72616e646f6dULL,
+    .v2 = k0 ^ 0x6c7967656e657261ULL,
+    .v3 = k1 ^ 0x7465646279746573ULL,
+    .tail = 0,
+    .length = 0,
+  };
+}
+
+inline void HasherUpdate(Hasher *h, const void *data, size_t length) {
+  const unsigned char *p = data;
+  size_t filled = h->length & 7;
+  h->length += length;
+  if (filled != 0) {
+    while (filled < 8 && length > 0) {
+      h->tail |= (uint64_t)*p++ << (8 * filled++);
+      length--;
     }
+    if (filled < 8) {
+      return;
+    }
+    HasherCompress(h, h->tail);
+    h->tail = 0;
+  }
+  for (; length >= 8; p += 8, length -= 8) {
+    HasherCompress(h, HashRead64(p));
+  }
+  for (size_t i = 0; i < length; i++) {
+    h->tail |= (uint64_t)p[i] << (8 * i);
   }
-  return -1;
 }
 
-inline char* StringDuplicate(const char *s) {
-  return strdup(s);
+inline uint64_t HasherFinish(const Hasher *hasher) {
+  Hasher h = *hasher;
+  HasherCompress(&h, h.tail | ((uint64_t)h.length << 56));
+  h.v2 ^= 0xff;
+  SIP_ROUND(&h);
+  SIP_ROUND(&h);
+  SIP_ROUND(&h);
+  return h.v0 ^ h.v1 ^ h.v2 ^ h.v3;
 }
 
-inline bool StringsJoinToBuffer(char *buffer, size_t buffer_size, char **strings, uint64_t number_of_strings, char *separator) {
-  size_t separator_length = StringLength(separator);
-  for (size_t i = 0; i < number_of_strings; i++) {
-    size_t string_length = StringLength(strings[i]);
-    if (string_length < buffer_size) {
-      strcat(buffer, strings[i]);
-      buffer_size -= string_length;
-    } else {
-      return false;
-    }
-    if (i + 1 < number_of_strings) {
-      if (separator_length < buffer_size) {
-        strcat(buffer, separator);
-        buffer_size -= separator_length;
-      } else {
-        return false;
-      }
+inline uint64_t SipHash(const void *data, size_t length, uint64_t k0, uint64_t k1) {
+  Hasher h = CreateHasher(k0, k1);
+  HasherUpdate(&h, data, length);
+  return HasherFinish(&h);
+}
+
+// Fills buffer from the operating system's random source.
+static bool OsRandomBytes(void *buffer, size_t length) {
+#if defined(_WIN32)
+  return BCRYPT_SUCCESS(BCryptGenRandom(NULL, buffer, (ULONG)length, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+  arc4random_buf(buffer, length);
+  return true;
+#else
+#ifdef CUTIL_HAS_GETRANDOM
+  if (getrandom(buffer, length, 0) == (ssize_t)length) {
+    return true;
+  }
+#endif
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = read(fd, (char*)buffer + done, length - done);
+    if (n <= 0 && !(n == -1 && errno == EINTR)) {
+      break;
     }
+    done += n > 0 ? n : 0;
   }
-  return true;
+  close(fd);
+  return done == length;
+#endif
 }
 
-inline char* StringsJoinAlloc(char **strings, uint64_t number_of_strings, char *separator) {
-  StringBuilder sb = CreateDynamicStringBuilder(1);
-  for (size_t i = 0; i < number_of_strings; i++) {
-    StringBuilderAddString(&sb, strings[i]);
-    if (i + 1 < number_of_strings) {
-      StringBuilderAddString(&sb, separator);
-    }
+inline uint64_t RandomSeed(void) {
+  uint64_t entropy[4] = {0};
+#ifndef _WIN32
+  static atomic_uint_fast64_t counter = 0;
+  entropy[3] = atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+#else
+  static volatile LONG64 counter = 0;
+  entropy[3] = InterlockedIncrement64(&counter);
+#endif
+  // Time and addresses only matter when the OS source is unavailable.
+  if (!OsRandomBytes(entropy, 2 * sizeof(uint64_t))) {
+    entropy[0] = (uint64_t)time(NULL);
+    entropy[1] = (uint64_t)clock();
   }
-  return sb.string;
+  entropy[2] = (uint64_t)(uintptr_t)&entropy;
+  return HashBytes(entropy, sizeof(entropy), (uint64_t)(uintptr_t)&counter);
 }
 
-void Sprintf(char *buffer, size_t buffer_size, const char *format, ...) {
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      *buffer++ = *format++;
-      if (--buffer_size - 1 == 0) {
-        goto End;
-      }
-      continue;
+static int HexDigitValue(char c);
+
+// Bytes that end the authority and the path, as MemoryFindAnyKernel tables.
+static const uint8_t url_authority_end[16] = {[3] = 0x04, [15] = 0x0C};
+static const uint8_t url_path_end[16] = {[3] = 0x04, [15] = 0x08};
+
+// RFC 3986: a scheme is a letter followed by letters, digits, '+', '-' and
+// '.', ended by ':', and only "//" starts an authority. UrlParse still passes
+// bare_authority, so that "host:port/path" without a scheme keeps the meaning
+// it always had there.
+static bool UrlParseViewWith(StringView s, UrlView *url, bool bare_authority) {
+  const char *p = s.ptr, *end = s.ptr + s.len, *q = p;
+  *url = (UrlView){0};
+  if (bare_authority) {
+    while (q < end && (CharIsAlphaNumeric(*q) || *q == '+' || *q == '-' || *q == '.')) {
+      q++;
     }
-    switch (*(++format)) {
-      case 'd':
-      case 'i': {
-        char s[20] = {0};
-        size_t i = 0;
-        Int64ToStringToBuffer(s, ArraySize(s), va_arg(valist, int64_t), 10);
-        while (s[i] != '\0') {
-          *buffer++ = s[i++];
-          if (--buffer_size - 1 == 0) {
-            goto End;
-          }
-        }
-        break;
-      }
-      case 'u': {
-        char s[21] = {0};
-        size_t i = 0;
-        Uint64ToStringToBuffer(s, ArraySize(s), va_arg(valist, uint64_t), 10);
-        while (s[i] != '\0') {
-          *buffer++ = s[i++];
-          if (--buffer_size - 1 == 0) {
-            goto End;
-          }
-        }
-        break;
-      }
-      case 'c':
-        *buffer++ = (char)va_arg(valist, int);
-        if (--buffer_size - 1 == 0) {
-          goto End;
-        }
-        break;
-      case 's': {
-        char *s = va_arg(valist, char*);
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size - 1 == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
-      }
-      case 'b': {
-        char *s = va_arg(valist, int) ? "true" : "false";
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size - 1 == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
-      }
-      case 'B': {
-        char *s = va_arg(valist, int) ? "TRUE" : "FALSE";
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size - 1 == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
-      }
-      default:
-        *buffer++ = '%';
-        if (--buffer_size - 1 == 0) {
-          goto End;
-        }
-        *buffer++ = *format;
-        if (--buffer_size - 1 == 0) {
-          goto End;
-        }
-        break;
+    if (q > p && end - q >= 3 && q[0] == ':' && q[1] == '/' && q[2] == '/') {
+      url->scheme = (StringView){p, q - p};
+      p = q + 1;
     }
-    format++;
   }
-End:
-  va_end(valist);
-}
-
-void Sappendf(char *buffer, size_t buffer_size, const char *format, ...) {
-  while (*buffer != '\0') {
-    buffer++;
-    if (--buffer_size == 0) {
-      goto End;
+  else if (p < end && CharIsAlpha(*p)) {
+    q++;
+    while (q < end && (CharIsAlphaNumeric(*q) || *q == '+' || *q == '-' || *q == '.')) {
+      q++;
+    }
+    if (q < end && *q == ':') {
+      url->scheme = (StringView){p, q - p};
+      p = q + 1;
     }
   }
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      *buffer++ = *format++;
-      if (--buffer_size == 0) {
-        goto End;
-      }
-      continue;
+  bool has_authority = end - p >= 2 && p[0] == '/' && p[1] == '/';
+  if (has_authority) {
+    p += 2;
+  }
+  else if (bare_authority && url->scheme.ptr == NULL) {
+    has_authority = p == end || p[0] != '/';
+  }
+  if (has_authority) {
+    const char *authority_end = MemoryFindAnyKernel(p, end - p, url_authority_end);
+    if (authority_end == NULL) {
+      authority_end = end;
     }
-    switch (*(++format)) {
-      case 'd':
-      case 'i': {
-        char s[20] = {0};
-        size_t i = 0;
-        Int64ToStringToBuffer(s, ArraySize(s), va_arg(valist, int64_t), 10);
-        while (s[i] != '\0') {
-          *buffer++ = s[i++];
-          if (--buffer_size == 0) {
-            goto End;
-          }
-        }
-        break;
-      }
-      case 'u': {
-        char s[21] = {0};
-        size_t i = 0;
-        Uint64ToStringToBuffer(s, ArraySize(s), va_arg(valist, uint64_t), 10);
-        while (s[i] != '\0') {
-          *buffer++ = s[i++];
-          if (--buffer_size == 0) {
-            goto End;
-          }
-        }
-        break;
+    const char *at = MemoryFindLastCharKernel(p, authority_end - p, '@');
+    if (at != NULL) {
+      url->userinfo = (StringView){p, at - p};
+      p = at + 1;
+    }
+    const char *colon;
+    if (p < authority_end && *p == '[') {
+      const char *close = MemoryFindCharKernel(p, authority_end - p, ']');
+      if (close == NULL || (close + 1 < authority_end && close[1] != ':')) {
+        return false;
       }
-      case 'c':
-        *buffer++ = (char)va_arg(valist, int);
-        if (--buffer_size == 0) {
-          goto End;
-        }
-        break;
-      case 's': {
-        char *s = va_arg(valist, char*);
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
+      url->host = (StringView){p + 1, close - p - 1};
+      colon = close + 1 < authority_end ? close + 1 : NULL;
+    }
+    else {
+      colon = MemoryFindLastCharKernel(p, authority_end - p, ':');
+      url->host = (StringView){p, (colon != NULL ? colon : authority_end) - p};
+    }
+    if (colon != NULL) {
+      url->port = (StringView){colon + 1, authority_end - colon - 1};
+      if (url->port.len > 5 || StringViewSpanClass(url->port, CHAR_CLASS_DIGIT) != url->port.len) {
+        return false;
       }
-      case 'b': {
-        char *s = va_arg(valist, int) ? "true" : "false";
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
+      uint32_t port = 0;
+      for (size_t i = 0; i < url->port.len; i++) {
+        port = port * 10 + (url->port.ptr[i] - '0');
       }
-      case 'B': {
-        char *s = va_arg(valist, int) ? "TRUE" : "FALSE";
-        while (*s != '\0') {
-          *buffer++ = *s;
-          if (--buffer_size == 0) {
-            goto End;
-          }
-          s++;
-        }
-        break;
+      if (port > 65535) {
+        return false;
       }
-      default:
-        *buffer++ = '%';
-        if (--buffer_size == 0) {
-          goto End;
-        }
-        *buffer++ = *format;
-        if (--buffer_size == 0) {
-          goto End;
-        }
-        break;
     }
-    format++;
+    p = authority_end;
   }
-End:
-  va_end(valist);
+  const char *path_end = MemoryFindAnyKernel(p, end - p, url_path_end);
+  if (path_end == NULL) {
+    path_end = end;
+  }
+  url->path = (StringView){p, path_end - p};
+  p = path_end;
+  if (p < end && *p == '?') {
+    const char *hash = MemoryFindCharKernel(p, end - p, '#');
+    url->query = (StringView){p + 1, (hash != NULL ? hash : end) - p - 1};
+    p = hash != NULL ? hash : end;
+  }
+  if (p < end) {
+    url->fragment = (StringView){p + 1, end - p - 1};
+  }
+  return true;
 }
 
-#pragma endregion
-#pragma region String Builder
-
-inline StringBuilder CreateStaticStringBuilder(char *buffer, size_t buffer_size) {
-  return (StringBuilder) {
-    .is_dynamic = false,
-    .capacity = buffer_size,
-    .length = 0,
-    .string = buffer,
-  };
+inline bool UrlParseView(StringView s, UrlView *url) {
+  return UrlParseViewWith(s, url, false);
 }
 
-inline StringBuilder CreateDynamicStringBuilder(size_t initial_capacity) {
-  if (initial_capacity == 0) {
-    initial_capacity = 1;
+inline size_t UrlParseBatch(const StringView *inputs, UrlView *urls, size_t number_of_urls) {
+  size_t i = 0;
+  while (i < number_of_urls && UrlParseView(inputs[i], &urls[i])) {
+    i++;
   }
-  return (StringBuilder) {
-    .is_dynamic = true,
-    .capacity = initial_capacity,
-    .length = 0,
-    .string = calloc(initial_capacity, 1),
-  };
+  return i;
 }
 
-inline bool AllocateStringBuilder(StringBuilder *sb, size_t initial_capacity) {
-  if (DeallocateStringBuilder(sb)) {
-    if (initial_capacity == 0) {
-      initial_capacity = 1;
+inline int32_t UrlViewPort(const UrlView *url) {
+  if (url->port.len > 0) {
+    int32_t port = 0;
+    for (size_t i = 0; i < url->port.len; i++) {
+      port = port * 10 + (url->port.ptr[i] - '0');
     }
-    sb->is_dynamic = true,
-    sb->capacity = initial_capacity;
-    sb->length = 0;
-    sb->string = calloc(initial_capacity, sizeof(char));
-    return sb->string != NULL;
+    return port;
   }
-  return false;
-}
-
-inline bool DeallocateStringBuilder(StringBuilder *sb) {
-  if (sb == NULL) {
-    return false;
+  if (StringViewEqualsIgnoreCase(url->scheme, StringViewLiteral("http"))) {
+    return 80;
   }
-  StringBuilderClear(sb);
-  if (sb->is_dynamic) {
-    free(sb->string);
+  if (StringViewEqualsIgnoreCase(url->scheme, StringViewLiteral("https"))) {
+    return 443;
   }
-  return true;
+  return -1;
 }
 
-inline bool StringBuilderCapacityRealloc(StringBuilder *sb, size_t padding) {
-  if (sb == NULL) {
-    return false;
+// Longer components are truncated to fit, as UrlParse always did.
+static void UrlCopyComponent(char *buffer, size_t buffer_size, StringView component) {
+  StringViewToBuffer(buffer, buffer_size, StringViewFirstN(component, buffer_size - 1));
+}
+
+inline Url UrlParse(const char *s) {
+  Url url = {0};
+  UrlView view;
+  if (!UrlParseViewWith(CreateStringView(s), &view, true)) {
+    return url;
   }
-  while (sb->length + padding >= sb->capacity) {
-    sb->capacity <<= 1;
+  UrlCopyComponent(url.scheme, ArraySize(url.scheme), view.scheme);
+  UrlCopyComponent(url.host, ArraySize(url.host), view.host);
+  UrlCopyComponent(url.path, ArraySize(url.path), view.path.len > 0 ? view.path : StringViewLiteral("/"));
+  if (view.port.len > 0) {
+    UrlCopyComponent(url.port, ArraySize(url.port), view.port);
   }
-  sb->string = realloc(sb->string, sizeof(char) * sb->capacity);
-  if (sb->string == NULL) {
-    return false;
+  else if (UrlViewPort(&view) != -1) {
+    IntegerToStringToBuffer(url.port, ArraySize(url.port), UrlViewPort(&view), false, 10);
+  }
+  if (view.query.ptr != NULL) {
+    url.query = (char*)view.query.ptr - 1;
+  }
+  return url;
+}
+
+inline UrlQueryIterator CreateUrlQueryIterator(StringView query) {
+  return (UrlQueryIterator){CreateStringSplitIteratorChar(query, '&'), false};
+}
+
+inline UrlQueryIterator CreateUrlQueryIteratorDecode(char *query, size_t length) {
+  return (UrlQueryIterator){CreateStringSplitIteratorChar((StringView){query, length}, '&'), true};
+}
+
+inline bool UrlQueryNext(UrlQueryIterator *it, StringView *key, StringView *value) {
+  StringView pair;
+  do {
+    if (!StringSplitNext(&it->pairs, &pair)) {
+      return false;
+    }
+  } while (pair.len == 0);
+  StringViewCut(pair, '=', key, value);
+  if (it->decode) {
+    key->len = UrlDecodeInPlace((char*)key->ptr, key->len);
+    value->len = UrlDecodeInPlace((char*)value->ptr, value->len);
   }
-  memset(sb->string + sb->length, '\0', sb->capacity - sb->length);
   return true;
 }
 
-inline bool StringBuilderAddChar(StringBuilder *sb, char c) {
-  if (sb == NULL) {
-    return false;
+inline size_t UrlDecodeInPlace(char *s, size_t length) {
+  size_t j = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    if (c == '%' && i + 2 < length && CharIsHexDigit(s[i + 1]) && CharIsHexDigit(s[i + 2])) {
+      c = (char)(HexDigitValue(s[i + 1]) << 4 | HexDigitValue(s[i + 2]));
+      i += 2;
+    }
+    else if (c == '+') {
+      c = ' ';
+    }
+    s[j++] = c;
   }
-  if (sb->length + 1 >= sb->capacity) {
-    if (!sb->is_dynamic) {
-      return false;
+  return j;
+}
+
+#pragma endregion
+#pragma region Encoding
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+static const char base64_alphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64_url_alphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Value of every base64 character of either alphabet, 255 for the rest.
+static const uint8_t base64_values[256] = {
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255,  62, 255,  63,
+   52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+  255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+   15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255,  63,
+  255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+   41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+static bool PercentIsUnreserved(char c) {
+  return CharIsAlphaNumeric(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// Runs of letters and digits are found with the class span kernel and
+// copied whole, the other bytes are handled one at a time.
+static size_t PercentEncodeRun(char *out, const char *s, size_t length) {
+  size_t j = 0;
+  for (size_t i = 0; i < length; i++) {
+    size_t span = MemorySpanClassKernel(s + i, length - i, CHAR_CLASS_ALNUM);
+    if (out != NULL) {
+      memcpy(out + j, s + i, span);
     }
-    if (!StringBuilderCapacityRealloc(sb, 1)) {
-      return false;
+    i += span;
+    j += span;
+    if (i == length) {
+      break;
+    }
+    if (PercentIsUnreserved(s[i])) {
+      if (out != NULL) {
+        out[j] = s[i];
+      }
+      j++;
+    }
+    else {
+      if (out != NULL) {
+        out[j] = '%';
+        out[j + 1] = "0123456789ABCDEF"[(unsigned char)s[i] >> 4];
+        out[j + 2] = "0123456789ABCDEF"[s[i] & 15];
+      }
+      j += 3;
     }
   }
-  sb->string[sb->length++] = c;
-  return true;
+  return j;
 }
 
-inline bool StringBuilderAddString(StringBuilder *sb, const char *s) {
-  if (sb == NULL) {
+static bool PercentIsEscape(const char *s, size_t length) {
+  return length >= 3 && s[0] == '%' && CharIsHexDigit(s[1]) && CharIsHexDigit(s[2]);
+}
+
+// Invalid escapes are copied as they are. Safe when out is s.
+static size_t PercentDecodeRun(char *out, const char *s, size_t length) {
+  size_t i = 0, j = 0;
+  while (i < length) {
+    const char *p = MemoryFindCharKernel(s + i, length - i, '%');
+    size_t span = p != NULL ? (size_t)(p - s) - i : length - i;
+    if (out != NULL) {
+      memmove(out + j, s + i, span);
+    }
+    i += span;
+    j += span;
+    if (i == length) {
+      break;
+    }
+    if (PercentIsEscape(s + i, length - i)) {
+      if (out != NULL) {
+        out[j] = (char)(HexDigitValue(s[i + 1]) << 4 | HexDigitValue(s[i + 2]));
+      }
+      i += 3;
+    }
+    else {
+      if (out != NULL) {
+        out[j] = '%';
+      }
+      i++;
+    }
+    j++;
+  }
+  return j;
+}
+
+static size_t HexEncodeRun(char *out, const char *s, size_t length) {
+  size_t i = HexEncodeBlocksKernel != NULL ? HexEncodeBlocksKernel(out, s, length) : 0;
+  for (; i < length; i++) {
+    out[2 * i] = hex_digits[(unsigned char)s[i] >> 4];
+    out[2 * i + 1] = hex_digits[s[i] & 15];
+  }
+  return 2 * length;
+}
+
+static bool HexDecodeRun(char *out, const char *s, size_t length, size_t *written) {
+  if (length % 2 != 0) {
     return false;
   }
-  size_t padding = StringLength(s);
-  if (sb->length + padding >= sb->capacity) {
-    if (!sb->is_dynamic) {
-      return false;
-    }
-    if (!StringBuilderCapacityRealloc(sb, padding)) {
+  size_t i = HexDecodeBlocksKernel != NULL ? HexDecodeBlocksKernel(out, s, length) : 0;
+  for (; i < length; i += 2) {
+    if (!CharIsHexDigit(s[i]) || !CharIsHexDigit(s[i + 1])) {
       return false;
     }
+    out[i / 2] = (char)(HexDigitValue(s[i]) << 4 | HexDigitValue(s[i + 1]));
   }
-  while (*s != '\0') {
-    sb->string[sb->length++] = *s++;
-  }
+  *written = length / 2;
   return true;
 }
 
-inline bool StringBuilderReadFile(StringBuilder *sb, const char *file_path) {
-  FILE *f = fopen(file_path, "rb");
-  if (f == NULL) {
-    return false;
+// The standard alphabet is padded with '=', the URL safe one is not.
+static size_t Base64EncodeRun(char *out, const char *s, size_t length, bool url) {
+  const char *alphabet = url ? base64_url_alphabet : base64_alphabet;
+  const unsigned char *u = (const unsigned char*)s;
+  size_t i = Base64EncodeBlocksKernel != NULL ? Base64EncodeBlocksKernel(out, s, length, url) : 0;
+  size_t j = i / 3 * 4;
+  for (; i + 3 <= length; i += 3, j += 4) {
+    uint32_t v = (uint32_t)u[i] << 16 | u[i + 1] << 8 | u[i + 2];
+    out[j] = alphabet[v >> 18];
+    out[j + 1] = alphabet[v >> 12 & 63];
+    out[j + 2] = alphabet[v >> 6 & 63];
+    out[j + 3] = alphabet[v & 63];
   }
-  uint64_t n;
-  do {
-    char fread_buffer[FREAD_BUFFER_SIZE] = {0};
-    n = fread(fread_buffer, sizeof(char), FREAD_BUFFER_SIZE, f);
-    for (size_t i = 0; i < n; i++) {
-      StringBuilderAddChar(sb, fread_buffer[i]);
+  if (i < length) {
+    uint32_t v = (uint32_t)u[i] << 16 | (i + 1 < length ? u[i + 1] << 8 : 0);
+    out[j++] = alphabet[v >> 18];
+    out[j++] = alphabet[v >> 12 & 63];
+    if (i + 1 < length) {
+      out[j++] = alphabet[v >> 6 & 63];
     }
-  } while (n == FREAD_BUFFER_SIZE);
-  return fclose(f) == 0;
+    else if (!url) {
+      out[j++] = '=';
+    }
+    if (!url) {
+      out[j++] = '=';
+    }
+  }
+  return j;
 }
 
-inline bool StringBuilderClear(StringBuilder *sb) {
-  if (sb != NULL && sb->length > 0) {
-    do {
-      sb->string[sb->length - 1] = '\0';
-    } while (--sb->length > 0);
-    sb->length = 0;
-    return true;
+// Length of the base64 characters without the padding, which is only
+// allowed to complete the last group of four.
+static size_t Base64UnpaddedLength(const char *s, size_t length) {
+  if (length % 4 == 0 && length > 0 && s[length - 1] == '=') {
+    length -= s[length - 2] == '=' ? 2 : 1;
   }
-  return false;
+  return length;
 }
 
-inline bool StringBuilderPrintf(StringBuilder *sb, const char *format, ...) {
-  if (sb == NULL) {
+// Either alphabet is accepted, padded or not. Safe when out is s.
+static bool Base64DecodeRun(char *out, const char *s, size_t length, size_t *written) {
+  const unsigned char *u = (const unsigned char*)s;
+  size_t n = Base64UnpaddedLength(s, length);
+  if (n % 4 == 1) {
     return false;
   }
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      if (!StringBuilderAddChar(sb, *format++)) {
-        return false;
-      }
-      continue;
+  size_t i = Base64DecodeBlocksKernel != NULL ? Base64DecodeBlocksKernel(out, s, n) : 0;
+  size_t j = i / 4 * 3;
+  for (; i + 4 <= n; i += 4, j += 3) {
+    uint32_t a = base64_values[u[i]], b = base64_values[u[i + 1]];
+    uint32_t c = base64_values[u[i + 2]], d = base64_values[u[i + 3]];
+    if ((a | b | c | d) & 0x80) {
+      return false;
     }
-    switch (*(++format)) {
-      case 'd':
-      case 'i': {
-        char buffer[20] = {0};
-        Int64ToStringToBuffer(buffer, ArraySize(buffer), va_arg(valist, int64_t), 10);
-        if (!StringBuilderAddString(sb, buffer)) {
-          return false;
-        }
-        break;
-      }
-      case 'u': {
-        char buffer[21] = {0};
-        Uint64ToStringToBuffer(buffer, ArraySize(buffer), va_arg(valist, uint64_t), 10);
-        if (!StringBuilderAddString(sb, buffer)) {
-          return false;
-        }
-        break;
-      }
-      case 'c':
-        if (!StringBuilderAddChar(sb, (char)va_arg(valist, int))) {
-          return false;
-        }
-        break;
-      case 's':
-        if (!StringBuilderAddString(sb, va_arg(valist, char*))) {
-          return false;
-        }
-        break;
-      case 'b':
-        if (!StringBuilderAddString(sb, va_arg(valist, int) ? "true" : "false")) {
-          return false;
-        }
-        break;
-      case 'B':
-        if (!StringBuilderAddString(sb, va_arg(valist, int) ? "TRUE" : "FALSE")) {
-          return false;
-        }
-        break;
-      default:
-        if (!StringBuilderAddChar(sb, '%')) {
-          return false;
-        }
-        if (!StringBuilderAddChar(sb, *format)) {
-          return false;
-        }
-        break;
+    uint32_t v = a << 18 | b << 12 | c << 6 | d;
+    out[j] = (char)(v >> 16);
+    out[j + 1] = (char)(v >> 8);
+    out[j + 2] = (char)v;
+  }
+  if (i < n) {
+    uint32_t a = base64_values[u[i]], b = base64_values[u[i + 1]];
+    uint32_t c = i + 2 < n ? base64_values[u[i + 2]] : 0;
+    if ((a | b | c) & 0x80) {
+      return false;
+    }
+    uint32_t v = a << 18 | b << 12 | c << 6;
+    out[j++] = (char)(v >> 16);
+    if (i + 2 < n) {
+      out[j++] = (char)(v >> 8);
     }
-    format++;
   }
-  va_end(valist);
+  *written = j;
   return true;
 }
 
-#pragma endregion
-#pragma region File System
+inline size_t EncodedLength(const char *s, size_t length, Codec codec) {
+  switch (codec) {
+    case CODEC_PERCENT:
+      return PercentEncodeRun(NULL, s, length);
+    case CODEC_HEX:
+      return 2 * length;
+    case CODEC_BASE64:
+      return (length + 2) / 3 * 4;
+    case CODEC_BASE64_URL:
+      return length / 3 * 4 + (length % 3 != 0 ? length % 3 + 1 : 0);
+  }
+  return 0;
+}
 
-inline bool FileExists(const char *file_path) {
-  return access(file_path, F_OK) == 0;
+inline size_t DecodedLength(const char *s, size_t length, Codec codec) {
+  switch (codec) {
+    case CODEC_PERCENT:
+      return PercentDecodeRun(NULL, s, length);
+    case CODEC_HEX:
+      return length / 2;
+    case CODEC_BASE64:
+    case CODEC_BASE64_URL: {
+      size_t n = Base64UnpaddedLength(s, length);
+      return n / 4 * 3 + (n % 4 > 1 ? n % 4 - 1 : 0);
+    }
+  }
+  return 0;
 }
 
-inline bool PathIsFile(const char *path) {
-  struct stat s;
-  if (stat(path, &s) == 0) {
-    return S_ISREG(s.st_mode);
+// Writes exactly EncodedLength bytes.
+static void EncodeRun(char *out, const char *s, size_t length, Codec codec) {
+  switch (codec) {
+    case CODEC_PERCENT:
+      PercentEncodeRun(out, s, length);
+      break;
+    case CODEC_HEX:
+      HexEncodeRun(out, s, length);
+      break;
+    case CODEC_BASE64:
+    case CODEC_BASE64_URL:
+      Base64EncodeRun(out, s, length, codec == CODEC_BASE64_URL);
+      break;
   }
-  return false;
 }
 
-inline bool PathIsDir(const char *path) {
-  struct stat s;
-  if (stat(path, &s) == 0) {
-    return S_ISDIR(s.st_mode);
+// Writes at most DecodedLength bytes, false for invalid input.
+static bool DecodeRun(char *out, const char *s, size_t length, Codec codec, size_t *written) {
+  switch (codec) {
+    case CODEC_PERCENT:
+      *written = PercentDecodeRun(out, s, length);
+      return true;
+    case CODEC_HEX:
+      return HexDecodeRun(out, s, length, written);
+    case CODEC_BASE64:
+    case CODEC_BASE64_URL:
+      return Base64DecodeRun(out, s, length, written);
   }
   return false;
 }
 
-inline bool CreateNewFile(const char *file_path) {
-  FILE *f = fopen(file_path, "wb");
-  if (f == NULL) {
+inline bool EncodeToBuffer(char *buffer, size_t buffer_size, const char *s, size_t length, Codec codec) {
+  size_t output_length = EncodedLength(s, length, codec);
+  if (output_length >= buffer_size) {
+    if (buffer_size > 0) {
+      buffer[0] = '\0';
+    }
     return false;
   }
-  return fclose(f) == 0;
-}
-
-inline bool RemoveFile(const char *file_path) {
-  return remove(file_path) == 0;
+  EncodeRun(buffer, s, length, codec);
+  buffer[output_length] = '\0';
+  return true;
 }
 
-inline char* PathBaseName(const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    return (char*)file_path;
-  } else {
-    return (char*)(file_path + index + 1);
+inline char* EncodeAlloc(const char *s, size_t length, Codec codec) {
+  size_t output_length = EncodedLength(s, length, codec);
+  char *result = AllocMemory(output_length + 1);
+  if (result != NULL) {
+    EncodeRun(result, s, length, codec);
+    result[output_length] = '\0';
   }
+  return result;
 }
 
-inline bool PathBaseNameToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
-  char *base_name = PathBaseName(file_path);
-  if (StringLength(base_name) < buffer_size) {
-    strcpy(buffer, base_name);
-    return true;
+inline bool StringBuilderAddEncoded(StringBuilder *sb, const char *s, size_t length, Codec codec) {
+  size_t output_length = EncodedLength(s, length, codec);
+  if (!StringBuilderReserve(sb, output_length)) {
+    return false;
   }
-  return false;
+  EncodeRun(sb->string + sb->length, s, length, codec);
+  sb->length += output_length;
+  sb->string[sb->length] = '\0';
+  return true;
 }
 
-inline bool PathDirNameToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    size_t length = StringLength(file_path);
-    if (length < buffer_size) {
-      strcpy(buffer, file_path);
-      return true;
+inline bool DecodeToBuffer(char *buffer, size_t buffer_size, const char *s, size_t length, Codec codec) {
+  size_t output_length;
+  if (DecodedLength(s, length, codec) >= buffer_size || !DecodeRun(buffer, s, length, codec, &output_length)) {
+    if (buffer_size > 0) {
+      buffer[0] = '\0';
     }
     return false;
   }
-  return StringSliceToBuffer(buffer, buffer_size, file_path, 0, index);
+  buffer[output_length] = '\0';
+  return true;
 }
 
-inline char* PathDirNameAlloc(const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    return strdup(file_path);
+inline char* DecodeAlloc(const char *s, size_t length, Codec codec) {
+  size_t output_length;
+  char *result = AllocMemory(DecodedLength(s, length, codec) + 1);
+  if (result != NULL) {
+    if (!DecodeRun(result, s, length, codec, &output_length)) {
+      FreeAllocMemory(result);
+      return NULL;
+    }
+    result[output_length] = '\0';
   }
-  return StringSliceAlloc(file_path, 0, index);
+  return result;
 }
 
-inline char* PathExt(const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    index = 0;
+inline bool StringBuilderAddDecoded(StringBuilder *sb, const char *s, size_t length, Codec codec) {
+  size_t output_length;
+  if (!StringBuilderReserve(sb, DecodedLength(s, length, codec))) {
+    return false;
   }
-  int64_t dot_index = StringLastIndexOf(file_path + index, ".");
-  if (dot_index == -1) {
-    return NULL;
+  if (!DecodeRun(sb->string + sb->length, s, length, codec, &output_length)) {
+    sb->string[sb->length] = '\0';
+    return false;
   }
-  return (char*)(file_path + index + dot_index);
+  sb->length += output_length;
+  sb->string[sb->length] = '\0';
+  return true;
 }
 
-inline bool PathExtToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    index = 0;
+inline CodecStream CreateCodecStream(Codec codec, bool decode) {
+  return (CodecStream){.codec = codec, .decode = decode};
+}
+
+// Number of trailing bytes that may belong to a group completed by the next
+// chunk. Holding back a '%' and what follows it never changes how the bytes
+// before it decode.
+static size_t CodecStreamHeldBack(const CodecStream *stream, const char *s, size_t length) {
+  switch (stream->codec) {
+    case CODEC_PERCENT:
+      if (!stream->decode) {
+        return 0;
+      }
+      if (length >= 2 && s[length - 2] == '%') {
+        return 2;
+      }
+      return length >= 1 && s[length - 1] == '%';
+    case CODEC_HEX:
+      return stream->decode ? length % 2 : 0;
+    case CODEC_BASE64:
+    case CODEC_BASE64_URL:
+      return stream->decode ? length % 4 : length % 3;
   }
-  int64_t dot_index = StringLastIndexOf(file_path + index, ".");
-  if (dot_index == -1) {
+  return 0;
+}
+
+static bool CodecStreamFeedGroups(CodecStream *stream, StringBuilder *sb, const char *chunk, size_t length) {
+  if (length == 0) {
+    return true;
+  }
+  if (stream->padded) {
     return false;
   }
-  return StringSliceToBuffer(buffer, buffer_size, file_path, index + dot_index, StringLength(file_path));
+  size_t held_back = CodecStreamHeldBack(stream, chunk, length);
+  size_t body = length - held_back;
+  if (stream->decode) {
+    if (!StringBuilderAddDecoded(sb, chunk, body, stream->codec)) {
+      return false;
+    }
+    stream->padded = body > 0 && chunk[body - 1] == '=' && stream->codec != CODEC_PERCENT;
+    if (stream->padded && held_back > 0) {
+      return false;
+    }
+  }
+  else if (!StringBuilderAddEncoded(sb, chunk, body, stream->codec)) {
+    return false;
+  }
+  memcpy(stream->carry, chunk + body, held_back);
+  stream->carry_length = held_back;
+  return true;
 }
 
-inline char* PathExtAlloc(const char *file_path) {
-  int64_t index = StringLastIndexOf(file_path, "/");
-  if (index == -1) {
-    index = 0;
+inline bool CodecStreamFeed(CodecStream *stream, StringBuilder *sb, const char *chunk, size_t length) {
+  while (stream->carry_length > 0 && length > 0) {
+    char group[8];
+    size_t take = length < 4 ? length : 4;
+    memcpy(group, stream->carry, stream->carry_length);
+    memcpy(group + stream->carry_length, chunk, take);
+    size_t group_length = stream->carry_length + take;
+    stream->carry_length = 0;
+    chunk += take;
+    length -= take;
+    if (!CodecStreamFeedGroups(stream, sb, group, group_length)) {
+      return false;
+    }
   }
-  int64_t dot_index = StringLastIndexOf(file_path + index, ".");
-  if (dot_index == -1) {
-    return NULL;
+  return CodecStreamFeedGroups(stream, sb, chunk, length);
+}
+
+inline bool CodecStreamFinish(CodecStream *stream, StringBuilder *sb) {
+  size_t length = stream->carry_length;
+  stream->carry_length = 0;
+  if (stream->decode) {
+    return StringBuilderAddDecoded(sb, stream->carry, length, stream->codec);
   }
-  return StringSliceAlloc(file_path, index + dot_index, StringLength(file_path));
+  return StringBuilderAddEncoded(sb, stream->carry, length, stream->codec);
 }
 
 #pragma endregion
-#pragma region IO
+#pragma region Conversions
 
-inline bool ReadFileToBuffer(char *buffer, size_t buffer_size, const char *file_path) {
-  FILE *f = fopen(file_path, "rb");
-  if (f == NULL) {
-    return false;
+inline int CharToInt(char c) {
+  if (CharIsDigit(c)) {
+    return c - 48;
   }
-  size_t buffer_index = 0, n;
-  do {
-    char fread_buffer[FREAD_BUFFER_SIZE] = {0};
-    n = fread(fread_buffer, sizeof(char), FREAD_BUFFER_SIZE, f);
-    for (size_t i = 0; i < n && buffer_index < buffer_size - 1; i++) {
-      buffer[buffer_index++] = fread_buffer[i];
-    }
-  } while (n == FREAD_BUFFER_SIZE);
-  return fclose(f) == 0;
+  return 0;
 }
 
-inline char* ReadFileAlloc(const char *file_path) {
-  StringBuilder sb = CreateDynamicStringBuilder(0);
-  if (StringBuilderReadFile(&sb, file_path)) {
-    return sb.string;
-  }
-  return NULL;
+inline int StringToInt32(const char *s) {
+  return atoi(s);
 }
 
-inline bool ReadUserInputToBuffer(char *buffer, size_t buffer_size) {
-  return fgets(buffer, buffer_size - 1, stdin) != NULL;
+inline int64_t StringToInt64(const char *s) {
+  return atoll(s);
 }
 
-inline bool ReadUserInputToStringBuilder(StringBuilder *sb) {
-  char c;
-  while ((c = fgetc(stdin), c != EOF && c != '\r' && c != '\n')) {
-    if (!StringBuilderAddChar(sb, c)) {
-      return false;
-    }
+inline bool CharToStringToBuffer(char *buffer, size_t buffer_size, char c) {
+  if (buffer_size > 1) {
+    buffer[0] = c;
+    buffer[1] = 0;
+    return true;
   }
-  return true;
+  return false;
 }
 
-inline char* ReadUserInputAlloc(void) {
-  StringBuilder sb = CreateDynamicStringBuilder(0);
-  if (ReadUserInputToStringBuilder(&sb)) {
-    return sb.string;
-  }
-  return NULL;
+inline char* CharToStringAlloc(char c) {
+  StringBuilder sb = CreateDynamicStringBuilder(2);
+  StringBuilderAddChar(&sb, c);
+  return sb.string;
 }
 
-inline bool WriteToFile(const char *file_path, const char *s) {
-  FILE *f = fopen(file_path, "wb");
-  if (f == NULL) {
-    return false;
+// Integers are written front to back: the digit count is known up front,
+// base 10 writes two digits per step from a table of digit pairs.
+
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const uint64_t powers_of_10[20] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+  1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+  1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+// Number of significant bits of value, at least 1.
+static int BitLength(uint64_t value) {
+  value |= 1;
+#if defined(__GNUC__) || defined(__clang__)
+  return 64 - __builtin_clzll(value);
+#else
+  int n = 0;
+  while (value != 0) {
+    value >>= 1;
+    n++;
   }
-  size_t length = StringLength(s);
-  uint64_t n = fwrite(s, sizeof(char), length, f);
-  return n == length && fclose(f) == 0;
+  return n;
+#endif
 }
 
-inline bool AppendToFile(const char *file_path, const char *s) {
-  FILE *f = fopen(file_path, "ab");
-  if (f == NULL) {
-    return false;
-  }
-  size_t length = StringLength(s);
-  uint64_t n = fwrite(s, sizeof(char), length, f);
-  return n == length && fclose(f) == 0;
+static size_t DecimalLength(uint64_t value) {
+  // bits * log10(2) is the digit count or one less.
+  int t = BitLength(value) * 1233 >> 12;
+  return t + ((value | 1) >= powers_of_10[t]);
 }
 
-void WriteStringToFile(FILE *file, const char *s) {
-  while (*s != '\0') {
-    putc(*s++, file);
+static void WriteDecimal(char *end, uint64_t value) {
+  while (value >= 100) {
+    size_t i = (value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    memcpy(end, digit_pairs + i, 2);
+  }
+  if (value >= 10) {
+    memcpy(end - 2, digit_pairs + value * 2, 2);
+  } else {
+    end[-1] = '0' + (char)value;
   }
 }
 
-inline void WriteStringToStdOut(const char *s) {
-  while (*s != '\0') {
-    putc(*s++, stdout);
+// Writes the sign and digits of value and a terminator. Returns the length,
+// or 0 with an empty string when it does not fit or the base is invalid.
+static size_t IntegerToStringToBuffer(char *buffer, size_t buffer_size, uint64_t value, bool negative, int32_t base) {
+  static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  if (buffer_size == 0) {
+    return 0;
+  }
+  *buffer = '\0';
+  if (base < 2 || base > 36) {
+    return 0;
+  }
+  size_t length;
+  if (base == 10) {
+    length = DecimalLength(value);
+  } else if (base == 16) {
+    length = (BitLength(value) + 3) / 4;
+  } else {
+    length = 1;
+    for (uint64_t v = value; v >= (uint64_t)base; v /= base) {
+      length++;
+    }
+  }
+  length += negative;
+  if (length >= buffer_size) {
+    return 0;
+  }
+  char *end = buffer + length;
+  *end = '\0';
+  if (base == 10) {
+    WriteDecimal(end, value);
+  } else if (base == 16) {
+    do {
+      *--end = digits[value & 15];
+      value >>= 4;
+    } while (value != 0);
+  } else {
+    do {
+      *--end = digits[value % base];
+      value /= base;
+    } while (value != 0);
+  }
+  if (negative) {
+    *buffer = '-';
   }
+  return length;
 }
 
-inline void WriteStringToStdErr(const char *s) {
-  while (*s != '\0') {
-    putc(*s++, stderr);
-  }
+inline bool Int32ToStringToBuffer(char *buffer, size_t buffer_size, int32_t value, int32_t base) {
+  return Int64ToStringToBuffer(buffer, buffer_size, value, base);
 }
 
-void WriteInt64ToFile(FILE *file, int64_t value) {
-  char buffer[20] = {0};
-	char *ptr = buffer;
-	while (true) {
-		int64_t tmp = value;
-		value /= 10;
-		*ptr++ = "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"[35 + (tmp - value * 10)];
-		if (value == 0) {
-			if (tmp < 0) {
-				*ptr++ = '-';
-			}
-			*ptr-- = '\0';
-			break;
-		}
-	}
-	while(ptr >= buffer) {
-		putc(*ptr--, file);
-	}
+inline bool Int64ToStringToBuffer(char *buffer, size_t buffer_size, int64_t value, int32_t base) {
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  return IntegerToStringToBuffer(buffer, buffer_size, magnitude, value < 0, base) > 0;
 }
 
-void WriteUint64ToFile(FILE *file, uint64_t value) {
-  char buffer[21] = {0};
-	char *ptr = buffer;
-	while (true) {
-		uint64_t tmp = value;
-		value /= 10;
-		*ptr++ = "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"[35 + (tmp - value * 10)];
-		if (value == 0) {
-			*ptr-- = '\0';
-			break;
-		}
-	}
-	while(ptr >= buffer) {
-		putc(*ptr--, file);
-	}
+inline bool Uint64ToStringToBuffer(char *buffer, size_t buffer_size, uint64_t value, int32_t base) {
+  return IntegerToStringToBuffer(buffer, buffer_size, value, false, base) > 0;
 }
 
-inline void WriteInt64ToStdOut(int64_t value) {
-	WriteInt64ToFile(stdout, value);
+// Shortest round-trip floating point output uses Grisu2 (see References).
+// The digits always read back as the same value, in rare cases one digit
+// longer than necessary. Fixed precision output is exact: the binary value
+// is scaled by 10^precision in 128-bit integer arithmetic and rounded half
+// to even, as printf does. Values out of that range use a big integer.
+
+typedef struct DiyFp {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+// 10^k for k = -348, -340, ..., 340, normalized to 64 bits.
+static const DiyFp cached_powers_of_10[87] = {
+  {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+  {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+  {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+  {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+  {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+  {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+  {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+  {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+  {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+  {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+  {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+  {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+  {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+  {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+  {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+  {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+  {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+  {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+  {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+  {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+  {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+  {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+  {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+  {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+  {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+  {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+  {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+  {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+  {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static DiyFp DiyFpMultiply(DiyFp x, DiyFp y) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 p = (unsigned __int128)x.f * y.f;
+  uint64_t h = (uint64_t)(p >> 64);
+  h += (uint64_t)p >> 63;
+  return (DiyFp){h, x.e + y.e + 64};
+#else
+  const uint64_t M32 = 0xFFFFFFFFULL;
+  uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+  tmp += 1ULL << 31;
+  return (DiyFp){ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+#endif
 }
 
-inline void WriteInt64ToStdErr(int64_t value) {
-	WriteInt64ToFile(stderr, value);
+static DiyFp DiyFpNormalize(DiyFp x) {
+  int shift = 64 - BitLength(x.f);
+  return (DiyFp){x.f << shift, x.e - shift};
 }
 
-inline void WriteUint64ToStdOut(uint64_t value) {
-	WriteUint64ToFile(stdout, value);
+// Digits and decimal exponent of the shortest representation within the
+// rounding interval of f * 2^e, where hidden is the implicit leading bit.
+static size_t Grisu2(uint64_t f, int e, uint64_t hidden, char *digits, int *exponent) {
+  DiyFp plus = DiyFpNormalize((DiyFp){(f << 1) + 1, e - 1});
+  DiyFp minus = f == hidden ? (DiyFp){(f << 2) - 1, e - 2} : (DiyFp){(f << 1) - 1, e - 1};
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+  // Cached power that brings the product's exponent into [-60, -32].
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  if (dk - k > 0.0) {
+    k++;
+  }
+  size_t index = (size_t)((k >> 3) + 1);
+  int K = -(-348 + (int)index * 8);
+  DiyFp c = cached_powers_of_10[index];
+  DiyFp w = DiyFpMultiply(DiyFpNormalize((DiyFp){f, e}), c);
+  DiyFp high = DiyFpMultiply(plus, c);
+  DiyFp low = DiyFpMultiply(minus, c);
+  low.f++;
+  high.f--;
+  uint64_t delta = high.f - low.f;
+  uint64_t distance = high.f - w.f;
+  DiyFp one = {1ULL << -high.e, high.e};
+  uint32_t p1 = (uint32_t)(high.f >> -one.e);
+  uint64_t p2 = high.f & (one.f - 1);
+  int kappa = (int)DecimalLength(p1);
+  // The integral digits are written up front, so the loop below only has
+  // to subtract instead of divide.
+  char integral[10];
+  WriteDecimal(integral + kappa, p1);
+  const char *next = integral;
+  size_t length = 0;
+  uint64_t rest, ten_kappa;
+  while (true) {
+    if (kappa > 0) {
+      uint32_t d = *next++ - '0';
+      p1 -= d * (uint32_t)powers_of_10[kappa - 1];
+      if (d != 0 || length != 0) {
+        digits[length++] = (char)('0' + d);
+      }
+      kappa--;
+      rest = ((uint64_t)p1 << -one.e) + p2;
+      if (rest <= delta) {
+        ten_kappa = powers_of_10[kappa] << -one.e;
+        break;
+      }
+    } else {
+      p2 *= 10;
+      delta *= 10;
+      uint32_t d = (uint32_t)(p2 >> -one.e);
+      if (d != 0 || length != 0) {
+        digits[length++] = (char)('0' + d);
+      }
+      p2 &= one.f - 1;
+      kappa--;
+      if (p2 < delta) {
+        rest = p2;
+        ten_kappa = one.f;
+        distance *= -kappa < 20 ? powers_of_10[-kappa] : 0;
+        break;
+      }
+    }
+  }
+  // Move the last digit towards w while staying inside the interval.
+  while (rest < distance && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+    digits[length - 1]--;
+    rest += ten_kappa;
+  }
+  *exponent = K + kappa;
+  return length;
 }
 
-inline void WriteUint64ToStdErr(uint64_t value) {
-	WriteUint64ToFile(stderr, value);
+// Lays out digits * 10^exponent as plain decimal, or with an exponent when
+// it is very large or small, the same way JavaScript does.
+static size_t FloatDigitsToString(char *buffer, const char *digits, size_t length, int exponent, bool negative) {
+  char *p = buffer;
+  if (negative) {
+    *p++ = '-';
+  }
+  int point = (int)length + exponent;
+  if (0 < point && point <= 21) {
+    if ((int)length <= point) {
+      memcpy(p, digits, length);
+      memset(p + length, '0', point - length);
+      p += point;
+    } else {
+      memcpy(p, digits, point);
+      p[point] = '.';
+      memcpy(p + point + 1, digits + point, length - point);
+      p += length + 1;
+    }
+  } else if (-6 < point && point <= 0) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -point);
+    p += -point;
+    memcpy(p, digits, length);
+    p += length;
+  } else {
+    *p++ = digits[0];
+    if (length > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, length - 1);
+      p += length - 1;
+    }
+    *p++ = 'e';
+    int e = point - 1;
+    *p++ = e < 0 ? '-' : '+';
+    p += IntegerToStringToBuffer(p, 4, e < 0 ? -e : e, false, 10);
+  }
+  *p = '\0';
+  return p - buffer;
 }
 
-void Printf(const char *format, ...) {
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      putchar(*format++);
-      continue;
+static size_t FloatSpecialToString(char *buffer, double value) {
+  const char *s = isnan(value) ? "nan" : value < 0 ? "-inf" : "inf";
+  size_t length = StringLength(s);
+  memcpy(buffer, s, length + 1);
+  return length;
+}
+
+// Shortest round-trip text of value, of the float it holds when is_float.
+// buffer must have room for FLOAT_STRING_SIZE characters.
+static size_t FloatingToShortest(char *buffer, double value, bool is_float) {
+  if (!isfinite(value)) {
+    return FloatSpecialToString(buffer, value);
+  }
+  bool negative = signbit(value) != 0;
+  if (value == 0) {
+    return FloatDigitsToString(buffer, "0", 1, 0, negative);
+  }
+  uint64_t f, hidden;
+  int e;
+  if (is_float) {
+    float x = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int biased = (bits >> 23) & 0xFF;
+    hidden = 1ULL << 23;
+    f = bits & (hidden - 1);
+    e = biased != 0 ? biased - 150 : -149;
+    f |= biased != 0 ? hidden : 0;
+  } else {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased = (int)((bits >> 52) & 0x7FF);
+    hidden = 1ULL << 52;
+    f = bits & (hidden - 1);
+    e = biased != 0 ? biased - 1075 : -1074;
+    f |= biased != 0 ? hidden : 0;
+  }
+  char digits[20];
+  int exponent;
+  size_t length = Grisu2(f, e, hidden, digits, &exponent);
+  return FloatDigitsToString(buffer, digits, length, exponent, negative);
+}
+
+// Fixed precision digits of f * 2^e rounded to precision decimals, right
+// aligned before end, without leading zeros. NULL when the scaled value does
+// not fit in 128 bits.
+static char* FixedDigits128(uint64_t f, int e, int precision, char *end) {
+#if defined(__SIZEOF_INT128__)
+  // f * 2^e * 10^precision must fit in 128 bits.
+  if (precision > 22 || e > 127 - 53 - (precision * 3322 + 999) / 1000) {
+    return NULL;
+  }
+  unsigned __int128 scaled = (unsigned __int128)f * powers_of_10[precision > 19 ? 19 : precision];
+  for (int i = 19; i < precision; i++) {
+    scaled *= 10;
+  }
+  if (e >= 0) {
+    scaled <<= e;
+  } else if (e > -128) {
+    unsigned __int128 rest = scaled & (((unsigned __int128)1 << -e) - 1);
+    unsigned __int128 half = (unsigned __int128)1 << (-e - 1);
+    scaled >>= -e;
+    scaled += rest > half || (rest == half && (scaled & 1));
+  } else {
+    // Below 2^-75, so less than half of the last decimal.
+    scaled = 0;
+  }
+  char *p = end;
+  do {
+    *--p = (char)('0' + (int)(scaled % 10));
+    scaled /= 10;
+  } while (scaled != 0);
+  return p;
+#else
+  (void)f;
+  (void)e;
+  (void)precision;
+  (void)end;
+  return NULL;
+#endif
+}
+
+// Same as FixedDigits128 for any double and precision, on a big integer of
+// 32-bit limbs (least significant first). 2^1024 * 10^99 needs 43 limbs.
+#define FIXED_DIGITS_LIMBS 44
+
+static char* FixedDigitsBig(uint64_t f, int e, int precision, char *end) {
+  uint32_t limbs[FIXED_DIGITS_LIMBS] = {(uint32_t)f, (uint32_t)(f >> 32)};
+  size_t n = 2;
+  for (int i = 0; i < precision; i += 9) {
+    uint32_t m = (uint32_t)powers_of_10[precision - i < 9 ? precision - i : 9];
+    uint64_t carry = 0;
+    for (size_t j = 0; j < n; j++) {
+      uint64_t product = (uint64_t)limbs[j] * m + carry;
+      limbs[j] = (uint32_t)product;
+      carry = product >> 32;
     }
-    switch (*(++format)) {
-      case 'd':
-      case 'i':
-        WriteInt64ToStdOut(va_arg(valist, int64_t));
-        break;
-      case 'u':
-        WriteUint64ToStdOut(va_arg(valist, uint64_t));
-        break;
-      case 'c':
-        putchar((char)va_arg(valist, int));
-        break;
-      case 's':
-        WriteStringToStdOut(va_arg(valist, char*));
-        break;
-      case 'b':
-        WriteStringToStdOut(va_arg(valist, int) ? "true" : "false");
-        break;
-      case 'B':
-        WriteStringToStdOut(va_arg(valist, int) ? "TRUE" : "FALSE");
-        break;
-      default:
-        putchar('%');
-        putchar(*format);
-        break;
+    if (carry != 0) {
+      limbs[n++] = (uint32_t)carry;
+    }
+  }
+  if (e > 0) {
+    size_t words = e / 32, bits = e % 32;
+    limbs[n] = 0;
+    for (size_t j = n + 1; j-- > 0;) {
+      uint32_t low = j > 0 && bits != 0 ? limbs[j - 1] >> (32 - bits) : 0;
+      limbs[j + words] = (limbs[j] << bits) | low;
+    }
+    memset(limbs, 0, words * sizeof(uint32_t));
+    n += words + 1;
+  } else if (e < 0) {
+    size_t words = (size_t)-e / 32, bits = (size_t)-e % 32;
+    // Round half to even on the bits that are shifted out.
+    size_t half_word = ((size_t)-e - 1) / 32, half_bit = ((size_t)-e - 1) % 32;
+    bool half = half_word < n && (limbs[half_word] >> half_bit) & 1;
+    bool below = half_word < n && (limbs[half_word] & ((1u << half_bit) - 1)) != 0;
+    for (size_t j = 0; j < half_word && j < n && !below; j++) {
+      below = limbs[j] != 0;
+    }
+    for (size_t j = 0; j < n; j++) {
+      uint64_t word = j + words < n ? limbs[j + words] : 0;
+      uint64_t high = j + words + 1 < n ? limbs[j + words + 1] : 0;
+      limbs[j] = (uint32_t)((word | high << 32) >> bits);
+    }
+    n = words < n ? n - words : 0;
+    while (n > 0 && limbs[n - 1] == 0) {
+      n--;
+    }
+    if (half && (below || (n > 0 && (limbs[0] & 1)))) {
+      size_t j = 0;
+      while (j < n && ++limbs[j] == 0) {
+        j++;
+      }
+      if (j == n) {
+        limbs[n++] = 1;
+      }
     }
-    format++;
   }
-  va_end(valist);
-}
-
-void Errorf(const char *format, ...) {
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      putc(*format++, stderr);
-      continue;
+  while (n > 0 && limbs[n - 1] == 0) {
+    n--;
+  }
+  // Nine digits at a time, by dividing by 10^9.
+  char *p = end;
+  do {
+    uint64_t rest = 0;
+    for (size_t j = n; j-- > 0;) {
+      uint64_t current = rest << 32 | limbs[j];
+      limbs[j] = (uint32_t)(current / 1000000000);
+      rest = current % 1000000000;
     }
-    switch (*(++format)) {
-      case 'd':
-      case 'i':
-        WriteInt64ToStdErr(va_arg(valist, int64_t));
-        break;
-      case 'u':
-        WriteUint64ToStdErr(va_arg(valist, uint64_t));
-        break;
-      case 'c':
-        putc((char)va_arg(valist, int), stderr);
-        break;
-      case 's':
-        WriteStringToStdErr(va_arg(valist, char*));
-        break;
-      case 'b':
-        WriteStringToStdErr(va_arg(valist, int) ? "true" : "false");
-        break;
-      case 'B':
-        WriteStringToStdErr(va_arg(valist, int) ? "TRUE" : "FALSE");
-        break;
-      default:
-        putc('%', stderr);
-        putc(*format, stderr);
-        break;
+    while (n > 0 && limbs[n - 1] == 0) {
+      n--;
+    }
+    for (int i = 0; i < 9 && (n > 0 || rest != 0 || p == end); i++) {
+      *--p = (char)('0' + rest % 10);
+      rest /= 10;
     }
-    format++;
+  } while (n > 0);
+  return p;
+}
+
+// Text of value rounded to precision decimals, the exact digits printf
+// gives in the C locale. buffer must have room for FLOAT_FIXED_STRING_SIZE
+// characters, precision is at most 99.
+static size_t FloatingToFixed(char *buffer, double value, int precision) {
+  if (!isfinite(value)) {
+    return FloatSpecialToString(buffer, value);
   }
-  va_end(valist);
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  int biased = (int)((bits >> 52) & 0x7FF);
+  uint64_t f = bits & ((1ULL << 52) - 1);
+  int e = biased != 0 ? biased - 1075 : -1074;
+  f |= biased != 0 ? 1ULL << 52 : 0;
+  char digits[FLOAT_FIXED_STRING_SIZE];
+  char *end = digits + sizeof(digits);
+  char *p = FixedDigits128(f, e, precision, end);
+  if (p == NULL) {
+    p = FixedDigitsBig(f, e, precision, end);
+  }
+  while (end - p <= precision) {
+    *--p = '0';
+  }
+  size_t integer = (end - p) - precision;
+  char *out = buffer;
+  if (signbit(value)) {
+    *out++ = '-';
+  }
+  memcpy(out, p, integer);
+  out += integer;
+  if (precision > 0) {
+    *out++ = '.';
+    memcpy(out, p + integer, precision);
+    out += precision;
+  }
+  *out = '\0';
+  return out - buffer;
 }
 
-bool WriteFormatToFile(const char *file_path, const char *format, ...) {
-  FILE *f = fopen(file_path, "wb");
-  if (f == NULL) {
+inline bool DoubleToStringToBuffer(char *buffer, size_t buffer_size, double value) {
+  char text[FLOAT_STRING_SIZE];
+  size_t length = FloatingToShortest(text, value, false);
+  if (length >= buffer_size) {
+    if (buffer_size > 0) {
+      *buffer = '\0';
+    }
     return false;
   }
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      putc(*format++, f);
-      continue;
-    }
-    switch (*(++format)) {
-      case 'd':
-      case 'i':
-        WriteInt64ToFile(f, va_arg(valist, int64_t));
-        break;
-      case 'u':
-        WriteUint64ToFile(f, va_arg(valist, uint64_t));
-        break;
-      case 'c':
-        putc((char)va_arg(valist, int), f);
-        break;
-      case 's':
-        WriteStringToFile(f, va_arg(valist, char*));
-        break;
-      case 'b':
-        WriteStringToFile(f, va_arg(valist, int) ? "true" : "false");
-        break;
-      case 'B':
-        WriteStringToFile(f, va_arg(valist, int) ? "TRUE" : "FALSE");
-        break;
-      default:
-        putc('%', f);
-        putc(*format, f);
-        break;
+  memcpy(buffer, text, length + 1);
+  return true;
+}
+
+inline bool FloatToStringToBuffer(char *buffer, size_t buffer_size, float value) {
+  char text[FLOAT_STRING_SIZE];
+  size_t length = FloatingToShortest(text, value, true);
+  if (length >= buffer_size) {
+    if (buffer_size > 0) {
+      *buffer = '\0';
     }
-    format++;
+    return false;
   }
-  va_end(valist);
-  return fclose(f) == 0;
+  memcpy(buffer, text, length + 1);
+  return true;
 }
 
-bool AppendFormatToFile(const char *file_path, const char *format, ...) {
-  FILE *f = fopen(file_path, "ab");
-  if (f == NULL) {
+inline bool DoubleToFixedStringToBuffer(char *buffer, size_t buffer_size, double value, int32_t precision) {
+  if (precision < 0 || precision > 99) {
+    if (buffer_size > 0) {
+      *buffer = '\0';
+    }
     return false;
   }
-  va_list valist;
-  va_start(valist, format);
-  while (*format != '\0') {
-    if (*format != '%') {
-      putc(*format++, f);
-      continue;
-    }
-    switch (*(++format)) {
-      case 'd':
-      case 'i':
-        WriteInt64ToFile(f, va_arg(valist, int64_t));
-        break;
-      case 'u':
-        WriteUint64ToFile(f, va_arg(valist, uint64_t));
-        break;
-      case 'c':
-        putc((char)va_arg(valist, int), f);
-        break;
-      case 's':
-        WriteStringToFile(f, va_arg(valist, char*));
-        break;
-      case 'b':
-        WriteStringToFile(f, va_arg(valist, int) ? "true" : "false");
-        break;
-      case 'B':
-        WriteStringToFile(f, va_arg(valist, int) ? "TRUE" : "FALSE");
-        break;
-      default:
-        putc('%', f);
-        putc(*format, f);
-        break;
+  char text[FLOAT_FIXED_STRING_SIZE];
+  size_t length = FloatingToFixed(text, value, precision);
+  if (length >= buffer_size) {
+    if (buffer_size > 0) {
+      *buffer = '\0';
     }
-    format++;
+    return false;
   }
-  va_end(valist);
-  return fclose(f) == 0;
+  memcpy(buffer, text, length + 1);
+  return true;
 }
 
-inline void WriteCharToStdOut(char c) {
-  putc(c, stdout);
+// Parsing works on (pointer, length) input. Runs of eight decimal digits
+// are checked and converted with SWAR arithmetic on one 64-bit load.
+// Doubles whose digits and exponent are exactly representable are computed
+// with a single multiplication or division (Clinger's fast path), anything
+// else goes through strtod with the decimal point taken out, so the result
+// does not depend on the locale.
+
+static bool IsDecimalDigit(char c) {
+  return (unsigned char)(c - '0') < 10;
 }
 
-inline void WriteCharToStdErr(char c) {
-  putc(c, stderr);
+#ifdef CUTIL_LITTLE_ENDIAN
+
+static bool IsEightDigits(uint64_t chunk) {
+  return (((chunk & 0xF0F0F0F0F0F0F0F0ULL) | (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
 }
 
-#pragma endregion
-#pragma region Util
+static uint64_t ParseEightDigits(uint64_t chunk) {
+  chunk -= 0x3030303030303030ULL;
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+           (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return chunk;
+}
 
-inline bool CreateAllocation(Allocation *a, size_t size) {
-  a->size = size;
-  a->memory = malloc(size);
-  if (a->memory == NULL) {
-    return false;
+#endif
+
+// Parses the decimal digits at the start of s. Returns the number of digits,
+// overflow is set when the value does not fit in 64 bits.
+static size_t ParseDecimalDigits(const char *s, size_t length, uint64_t *value, bool *overflow) {
+  size_t i = 0;
+  while (i < length && s[i] == '0') {
+    i++;
   }
-  memset(a->memory, 0, size);
-  return true;
+  size_t start = i;
+  uint64_t v = 0;
+#ifdef CUTIL_LITTLE_ENDIAN
+  while (i + 8 <= length && i - start < 16) {
+    uint64_t chunk;
+    memcpy(&chunk, s + i, 8);
+    if (!IsEightDigits(chunk)) {
+      break;
+    }
+    v = v * 100000000 + ParseEightDigits(chunk);
+    i += 8;
+  }
+#endif
+  *overflow = false;
+  for (; i < length && IsDecimalDigit(s[i]); i++) {
+    uint64_t digit = s[i] - '0';
+    if (i - start < 19) {
+      v = v * 10 + digit;
+    } else if (i - start == 19 && v <= (UINT64_MAX - digit) / 10) {
+      v = v * 10 + digit;
+    } else {
+      *overflow = true;
+    }
+  }
+  *value = v;
+  return i;
 }
 
-inline bool ResizeAllocation(Allocation *a, size_t size) {
-  if (size == a->size) {
-    return true;
+// Parses an optional sign and decimal digits into a magnitude at most limit
+// (plus one when negative).
+static bool ParseSigned(const char *s, size_t length, uint64_t limit, uint64_t *magnitude, bool *negative, size_t *consumed) {
+  size_t i = 0;
+  *negative = false;
+  if (length > 0 && (s[0] == '-' || s[0] == '+')) {
+    *negative = s[0] == '-';
+    i++;
   }
-  a->memory = realloc(a->memory, size);
-  if (a->memory == NULL) {
-    return false;
+  bool overflow;
+  size_t digits = ParseDecimalDigits(s + i, length - i, magnitude, &overflow);
+  if (consumed != NULL) {
+    *consumed = digits > 0 ? i + digits : 0;
   }
-  memset(a->memory + a->size, 0, size - a->size);
-  a->size = size;
-  return true;
+  return digits > 0 && !overflow && *magnitude <= limit + *negative;
 }
 
-inline void FreeAllocation(Allocation *a) {
-  a->size = 0;
-  free(a->memory);
+inline bool ParseInt32(const char *s, size_t length, int32_t *value, size_t *consumed) {
+  uint64_t magnitude;
+  bool negative;
+  if (!ParseSigned(s, length, INT32_MAX, &magnitude, &negative, consumed)) {
+    return false;
+  }
+  *value = negative ? (int32_t)(0 - (uint32_t)magnitude) : (int32_t)magnitude;
+  return true;
 }
 
-inline bool CreateMemoryAllocation(MemoryAllocation *ma, size_t size_of_item, uint64_t number_of_items) {
-  ma->number_of_items = number_of_items;
-  ma->size_of_item = size_of_item;
-  ma->memory = calloc(number_of_items, size_of_item);
-  return ma->memory != NULL;
+inline bool ParseInt64(const char *s, size_t length, int64_t *value, size_t *consumed) {
+  uint64_t magnitude;
+  bool negative;
+  if (!ParseSigned(s, length, INT64_MAX, &magnitude, &negative, consumed)) {
+    return false;
+  }
+  *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+  return true;
 }
 
-inline bool ResizeMemoryAllocation(MemoryAllocation *ma, uint64_t number_of_items) {
-  if (number_of_items == ma->number_of_items) {
-    return true;
+inline bool ParseUint64(const char *s, size_t length, uint64_t *value, size_t *consumed) {
+  size_t i = length > 0 && s[0] == '+';
+  uint64_t v;
+  bool overflow;
+  size_t digits = ParseDecimalDigits(s + i, length - i, &v, &overflow);
+  if (consumed != NULL) {
+    *consumed = digits > 0 ? i + digits : 0;
   }
-  size_t old_size = ma->size_of_item * ma->number_of_items;
-  uint64_t new_size = ma->size_of_item * number_of_items;
-  ma->memory = realloc(ma->memory, new_size);
-  if (ma->memory == NULL) {
+  if (digits == 0 || overflow) {
     return false;
   }
-  if (new_size > old_size) {
-    memset(ma->memory + old_size, 0, new_size - old_size);
-  }
-  ma->number_of_items = number_of_items;
+  *value = v;
   return true;
 }
 
-inline void FreeMemoryAllocation(MemoryAllocation *ma) {
-  ma->number_of_items = 0;
-  free(ma->memory);
+static int HexDigitValue(char c) {
+  if (IsDecimalDigit(c)) {
+    return c - '0';
+  }
+  c |= 0x20;
+  if ('a' <= c && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
 }
 
-inline uint64_t Hash(const char *s) {
-  unsigned char *us = (unsigned char*)s;
-  uint64_t hash = 5381;
-  while (*us != '\0') {
-    hash = ((hash << 5) + hash) + *us++;
+inline bool ParseHex64(const char *s, size_t length, uint64_t *value, size_t *consumed) {
+  size_t i = 0;
+  if (length > 2 && s[0] == '0' && (s[1] | 0x20) == 'x' && HexDigitValue(s[2]) >= 0) {
+    i = 2;
   }
-  return hash;
+  size_t start = i;
+  while (i < length && s[i] == '0') {
+    i++;
+  }
+  size_t significant = i;
+  uint64_t v = 0;
+  int digit;
+  for (; i < length && (digit = HexDigitValue(s[i])) >= 0; i++) {
+    v = v << 4 | digit;
+  }
+  if (consumed != NULL) {
+    *consumed = i > start ? i : 0;
+  }
+  if (i == start || i - significant > 16) {
+    return false;
+  }
+  *value = v;
+  return true;
 }
 
-inline Url UrlParse(const char *s) {
-  Url url = {0};
-  int64_t scheme_index = StringFirstIndexOf(s, "://");
-  int64_t host_begin_index = 0;
-  int64_t port_begin_index = 0;
-  int64_t path_begin_index = 0;
-  int64_t query_begin_index = 0;
-  if (scheme_index != -1) {
-    StringSliceToBuffer(url.scheme, ArraySize(url.scheme), s, 0, scheme_index);
-    host_begin_index = scheme_index + 3;
-  }
-  for (int64_t i = host_begin_index + 1;; i++) {
-    switch (s[i]) {
-      case ':':
-        StringSliceToBuffer(url.host, ArraySize(url.host), s, host_begin_index, i);
-        port_begin_index = i + 1;
-        goto ReadPort;
-      case '/':
-        StringSliceToBuffer(url.host, ArraySize(url.host), s, host_begin_index, i);
-        path_begin_index = i;
-        goto ReadPath;
-      case '?':
-        StringSliceToBuffer(url.host, ArraySize(url.host), s, host_begin_index, i);
-        query_begin_index = i;
-        goto ReadQuery;
-      case '\0':
-        StringSliceToBuffer(url.host, ArraySize(url.host), s, host_begin_index, i);
-        goto FunctionReturn;
-    }
-  }
-  ReadPort: {
-    for (int64_t i = port_begin_index;; i++) {
-      switch (s[i]) {
-        case '/':
-          StringSliceToBuffer(url.port, ArraySize(url.port), s, port_begin_index, i);
-          path_begin_index = i;
-          goto ReadPath;
-        case '?':
-          StringSliceToBuffer(url.port, ArraySize(url.port), s, port_begin_index, i);
-          query_begin_index = i;
-          goto ReadQuery;
-        case '\0':
-          StringSliceToBuffer(url.port, ArraySize(url.port), s, port_begin_index, i);
-          goto FunctionReturn;
+static const double powers_of_10_double[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+inline bool ParseDouble(const char *s, size_t length, double *value, size_t *consumed) {
+  size_t i = 0;
+  bool negative = false;
+  if (length > 0 && (s[0] == '-' || s[0] == '+')) {
+    negative = s[0] == '-';
+    i++;
+  }
+  if (consumed != NULL) {
+    *consumed = 0;
+  }
+  if (i < length && !IsDecimalDigit(s[i]) && s[i] != '.') {
+    double special;
+    if (StringViewStartsWithIgnoreCase((StringView){s + i, length - i}, StringViewLiteral("infinity"))) {
+      special = INFINITY;
+      i += 8;
+    } else if (StringViewStartsWithIgnoreCase((StringView){s + i, length - i}, StringViewLiteral("inf"))) {
+      special = INFINITY;
+      i += 3;
+    } else if (StringViewStartsWithIgnoreCase((StringView){s + i, length - i}, StringViewLiteral("nan"))) {
+      special = NAN;
+      i += 3;
+    } else {
+      return false;
+    }
+    *value = negative ? -special : special;
+    if (consumed != NULL) {
+      *consumed = i;
+    }
+    return true;
+  }
+  // Up to 19 significant digits go into mantissa, exponent is adjusted for
+  // the digits that do not.
+  uint64_t mantissa = 0;
+  int64_t exponent = 0;
+  size_t significant = 0;
+  size_t digits = 0;
+  bool truncated = false;
+  for (; i < length && IsDecimalDigit(s[i]); i++, digits++) {
+    if (significant < 19) {
+      mantissa = mantissa * 10 + (s[i] - '0');
+      significant += mantissa != 0;
+    } else {
+      exponent++;
+      truncated |= s[i] != '0';
+    }
+  }
+  if (i < length && s[i] == '.') {
+    i++;
+    for (; i < length && IsDecimalDigit(s[i]); i++, digits++) {
+      if (significant < 19) {
+        mantissa = mantissa * 10 + (s[i] - '0');
+        significant += mantissa != 0;
+        exponent--;
+      } else {
+        truncated |= s[i] != '0';
       }
     }
   }
-  ReadPath: {
-    for (int64_t i = path_begin_index;; i++) {
-      switch (s[i]) {
-        case '?':
-          StringSliceToBuffer(url.path, ArraySize(url.path), s, path_begin_index, i);
-          query_begin_index = i;
-          goto ReadQuery;
-        case '\0':
-          StringSliceToBuffer(url.path, ArraySize(url.path), s, path_begin_index, i);
-          goto FunctionReturn;
+  if (digits == 0) {
+    return false;
+  }
+  int64_t explicit_exponent = 0;
+  if (i < length && (s[i] | 0x20) == 'e') {
+    size_t j = i + 1;
+    bool exponent_negative = false;
+    if (j < length && (s[j] == '-' || s[j] == '+')) {
+      exponent_negative = s[j] == '-';
+      j++;
+    }
+    if (j < length && IsDecimalDigit(s[j])) {
+      int64_t e = 0;
+      for (; j < length && IsDecimalDigit(s[j]); j++) {
+        if (e < 100000) {
+          e = e * 10 + (s[j] - '0');
+        }
       }
+      explicit_exponent = exponent_negative ? -e : e;
+      exponent += explicit_exponent;
+      i = j;
     }
   }
-  ReadQuery: {
-    url.query = (char*)(s + query_begin_index);
+  if (consumed != NULL) {
+    *consumed = i;
   }
-  FunctionReturn: {
-    if (url.path[0] == '\0') {
-      url.path[0] = '/';
+#if FLT_EVAL_METHOD == 0
+  if (!truncated && mantissa <= (1ULL << 53)) {
+    double result = (double)mantissa;
+    if (mantissa == 0) {
+      *value = negative ? -0.0 : 0.0;
+      return true;
     }
-    if (StringEquals(url.scheme, "http")) {
-      strcpy(url.port, "80");
+    if (-22 <= exponent && exponent <= 22) {
+      result = exponent < 0 ? result / powers_of_10_double[-exponent] : result * powers_of_10_double[exponent];
+      *value = negative ? -result : result;
+      return true;
     }
-    else if (StringEquals(url.scheme, "https")) {
-      strcpy(url.port, "443");
+    if (22 < exponent && exponent <= 22 + 15 && mantissa <= (1ULL << 53) / powers_of_10[exponent - 22]) {
+      result = (double)(mantissa * powers_of_10[exponent - 22]) * 1e22;
+      *value = negative ? -result : result;
+      return true;
     }
-    return url;
   }
+#endif
+  // strtod expects the decimal point of the current locale, so the copy
+  // leaves it out: the sign and all digits, then the adjusted exponent.
+  char stack[64];
+  char *copy = i + 24 <= sizeof(stack) ? stack : malloc(i + 24);
+  if (copy == NULL) {
+    return false;
+  }
+  size_t n = 0;
+  int64_t scale = explicit_exponent;
+  bool fraction = false;
+  for (size_t j = 0; j < i && (s[j] | 0x20) != 'e'; j++) {
+    if (s[j] == '.') {
+      fraction = true;
+    } else {
+      copy[n++] = s[j];
+      scale -= fraction;
+    }
+  }
+  copy[n++] = 'e';
+  Int64ToStringToBuffer(copy + n, 24, scale, 10);
+  double result = strtod(copy, NULL);
+  if (copy != stack) {
+    free(copy);
+  }
+  if (isinf(result)) {
+    return false;
+  }
+  *value = result;
+  return true;
 }
 
 #pragma endregion
-#pragma region Conversions
+#pragma region Hash map
 
-inline int CharToInt(char c) {
-  if (CharIsDigit(c)) {
-    return c - 48;
-  }
-  return 0;
-}
+// Open addressing with Robin Hood probing. Keys are hashed with SipHash keyed
+// by a random per-map seed. Every slot caches the hash of its key, a hash of
+// 0 marks an empty slot. Removal shifts the following entries
+// back by one instead of leaving tombstones.
 
-inline int StringToInt32(const char *s) {
-  return atoi(s);
-}
+#define STRING_HASH_MAP_MIN_CAPACITY 8
 
-inline int64_t StringToInt64(const char *s) {
-  return atoll(s);
+static uint64_t StringHashMapHash(const StringHashMap *hm, const char *key, size_t length) {
+  return SipHash(key, length, hm->seed[0], hm->seed[1]) | 0x8000000000000000ULL;
 }
 
-inline bool CharToStringToBuffer(char *buffer, size_t buffer_size, char c) {
-  if (buffer_size > 1) {
-    buffer[0] = c;
-    buffer[1] = 0;
-    return true;
+// Whether the stored key is exactly the first length bytes of key.
+static bool StringHashMapKeyEquals(const char *stored, const char *key, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (stored[i] != key[i] || stored[i] == '\0') {
+      return false;
+    }
   }
-  return false;
+  return stored[length] == '\0';
 }
 
-inline char* CharToStringAlloc(char c) {
-  StringBuilder sb = CreateDynamicStringBuilder(2);
-  StringBuilderAddChar(&sb, c);
-  return sb.string;
+static size_t StringHashMapDistance(const StringHashMap *hm, size_t index) {
+  return (index - (hm->items[index].hash & (hm->capacity - 1))) & (hm->capacity - 1);
 }
 
-inline bool Int32ToStringToBuffer(char *buffer, size_t buffer_size, int32_t value, int32_t base) {
-  if (base < 2 || base > 36) {
-    *buffer = '\0';
-    return false;
-  }
-  char *ptr1 = buffer;
-  while (true) {
-    if (--buffer_size == 0) {
-      return false;
-    }
-    int tmp = value;
-    value /= base;
-    *ptr1++ = "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"[35 + (tmp - value * base)];
-    if (value == 0) {
-      if (tmp < 0) {
-        *ptr1++ = '-';
-      }
-      *ptr1-- = '\0';
-      break;
+static void StringHashMapInsert(StringHashMap *hm, StringHashMapValue v) {
+  size_t mask = hm->capacity - 1;
+  size_t index = v.hash & mask, distance = 0;
+  while (hm->items[index].hash != 0) {
+    size_t existing = StringHashMapDistance(hm, index);
+    if (existing < distance) {
+      StringHashMapValue tmp = hm->items[index];
+      hm->items[index] = v;
+      v = tmp;
+      distance = existing;
     }
+    index = (index + 1) & mask;
+    distance++;
   }
-  while(buffer < ptr1) {
-    char tmp = *ptr1;
-    *ptr1-- = *buffer;
-    *buffer++ = tmp;
-  }
-  return true;
+  hm->items[index] = v;
+  hm->length++;
 }
 
-inline bool Int64ToStringToBuffer(char *buffer, size_t buffer_size, int64_t value, int32_t base) {
-  if (base < 2 || base > 36) {
-    *buffer = '\0';
-    return false;
+static int64_t StringHashMapFind(const StringHashMap *hm, const char *key, size_t length, uint64_t hash) {
+  if (hm->capacity == 0) {
+    return -1;
   }
-  char *ptr1 = buffer;
-  while (true) {
-    if (--buffer_size == 0) {
-      return false;
+  size_t mask = hm->capacity - 1;
+  size_t index = hash & mask;
+  for (size_t distance = 0;; distance++) {
+    const StringHashMapValue *v = &hm->items[index];
+    if (v->hash == 0 || StringHashMapDistance(hm, index) < distance) {
+      return -1;
     }
-    int tmp = value;
-    value /= base;
-    *ptr1++ = "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"[35 + (tmp - value * base)];
-    if (value == 0) {
-      if (tmp < 0) {
-        *ptr1++ = '-';
-      }
-      *ptr1-- = '\0';
-      break;
+    if (v->hash == hash && StringHashMapKeyEquals(v->key, key, length)) {
+      return index;
     }
+    index = (index + 1) & mask;
   }
-  while(buffer < ptr1) {
-    char tmp = *ptr1;
-    *ptr1-- = *buffer;
-    *buffer++ = tmp;
-  }
-  return true;
 }
 
-inline bool Uint64ToStringToBuffer(char *buffer, size_t buffer_size, uint64_t value, int32_t base) {
-  if (base < 2 || base > 36) {
-    *buffer = '\0';
+static bool StringHashMapResize(StringHashMap *hm, size_t capacity) {
+  StringHashMapValue *items = calloc(capacity, sizeof(StringHashMapValue));
+  if (items == NULL) {
     return false;
   }
-  char *ptr1 = buffer;
-  while (true) {
-    if (--buffer_size == 0) {
-      return false;
-    }
-    uint64_t tmp = value;
-    value /= base;
-    *ptr1++ = "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"[35 + (tmp - value * base)];
-    if (value == 0) {
-      *ptr1-- = '\0';
-      break;
+  StringHashMapValue *old_items = hm->items;
+  size_t old_capacity = hm->capacity;
+  hm->items = items;
+  hm->capacity = capacity;
+  hm->length = 0;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_items[i].hash != 0) {
+      StringHashMapInsert(hm, old_items[i]);
     }
   }
-  while(buffer < ptr1) {
-    char tmp = *ptr1;
-    *ptr1-- = *buffer;
-    *buffer++ = tmp;
-  }
+  free(old_items);
   return true;
 }
 
-#pragma endregion
-#pragma region Hash map
-
-inline StringHashMapValue* NewStringHashMapValue(char *key, char *value) {
-  StringHashMapValue *v = malloc(sizeof(StringHashMapValue));
-  if (v == NULL) {
-    return NULL;
-  }
-  v->key = key;
-  v->value = value;
-  v->next = NULL;
-  return v;
-}
-
 inline bool AllocateStringHashMap(StringHashMap *hm, size_t capacity) {
   if (DeallocateStringHashMap(hm)) {
-    hm->capacity = capacity;
-    hm->length = 0;
-    hm->items = calloc(capacity, sizeof(StringHashMapValue*));
+    *hm = CreateStringHashMap(capacity);
     return hm->items != NULL;
   }
   return false;
@@ -1627,59 +5721,75 @@ inline bool AllocateStringHashMap(StringHashMap *hm, size_t capacity) {
 inline bool DeallocateStringHashMap(StringHashMap *hm) {
   if (hm != NULL) {
     hm->length = 0;
+    hm->capacity = 0;
     free(hm->items);
+    hm->items = NULL;
     return true;
   }
   return false;
 }
 
 inline StringHashMap CreateStringHashMap(size_t capacity) {
+  size_t power = STRING_HASH_MAP_MIN_CAPACITY;
+  while (power < capacity) {
+    power <<= 1;
+  }
+  StringHashMapValue *items = calloc(power, sizeof(StringHashMapValue));
   return (StringHashMap) {
-    .capacity = capacity,
+    .capacity = items == NULL ? 0 : power,
     .length = 0,
-    .items = calloc(capacity, sizeof(StringHashMapValue*)),
+    .items = items,
+    .seed = {RandomSeed(), RandomSeed()},
   };
 }
 
-inline void StringHashMapSet(StringHashMap *hm, char *key, char *value) {
-  StringHashMapValue *v = NewStringHashMapValue(key, value);
-  size_t index = Hash(key) % hm->capacity;
-  if (hm->items[index] == NULL) {
-    hm->items[index] = v;
-  } else {
-    StringHashMapValue *tmp = hm->items[index];
-    while (tmp->next != NULL) {
-      tmp = tmp->next;
+inline bool StringHashMapSet(StringHashMap *hm, char *key, char *value) {
+  size_t length = StringLength(key);
+  uint64_t hash = StringHashMapHash(hm, key, length);
+  int64_t index = StringHashMapFind(hm, key, length, hash);
+  if (index != -1) {
+    hm->items[index].value = value;
+    return true;
+  }
+  if ((hm->length + 1) * 8 > hm->capacity * 7) {
+    size_t capacity = hm->capacity > 0 ? hm->capacity * 2 : STRING_HASH_MAP_MIN_CAPACITY;
+    if (!StringHashMapResize(hm, capacity)) {
+      return false;
     }
-    tmp->next = v;
   }
+  StringHashMapInsert(hm, (StringHashMapValue) {
+    .key = key,
+    .value = value,
+    .hash = hash,
+  });
+  return true;
 }
 
 inline char* StringHashMapGet(StringHashMap *hm, char *key) {
-  StringHashMapValue *tmp = hm->items[Hash(key) % hm->capacity];
-  while (tmp != NULL && !StringEquals(key, tmp->key)) {
-    tmp = tmp->next;
-  }
-  return tmp == NULL ? NULL : tmp->value;
+  return StringHashMapGetView(hm, CreateStringView(key));
+}
+
+inline char* StringHashMapGetView(StringHashMap *hm, StringView key) {
+  int64_t index = StringHashMapFind(hm, key.ptr, key.len, StringHashMapHash(hm, key.ptr, key.len));
+  return index == -1 ? NULL : hm->items[index].value;
 }
 
 inline bool StringHashMapRemove(StringHashMap *hm, char *key) {
-  size_t index = Hash(key) % hm->capacity;
-  StringHashMapValue *tmp = hm->items[index];
-  if (tmp != NULL) {
-    if (StringEquals(tmp->key, key)) {
-      hm->items[index] = tmp->next;
-      return true;
-    }
-    while (tmp->next != NULL) {
-      if (StringEquals(tmp->next->key, key)) {
-        tmp->next = tmp->next->next;
-        return true;
-      }
-      tmp = tmp->next;
-    }
+  size_t length = StringLength(key);
+  int64_t index = StringHashMapFind(hm, key, length, StringHashMapHash(hm, key, length));
+  if (index == -1) {
+    return false;
   }
-  return false;
+  size_t mask = hm->capacity - 1;
+  size_t next = (index + 1) & mask;
+  while (hm->items[next].hash != 0 && StringHashMapDistance(hm, next) > 0) {
+    hm->items[index] = hm->items[next];
+    index = next;
+    next = (next + 1) & mask;
+  }
+  hm->items[index] = (StringHashMapValue) {0};
+  hm->length--;
+  return true;
 }
 
 #pragma endregion